@@ -0,0 +1,122 @@
+/*
+ * This file is part of Connect4 Game Solver <http://connect4.gamesolver.org>
+ * Copyright (C) 2017-2019 Pascal Pons <contact@gamesolver.org>
+ *
+ * Connect4 Game Solver is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Connect4 Game Solver is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Connect4 Game Solver. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ANSWER_CACHE_HPP
+#define ANSWER_CACHE_HPP
+
+#include "Position.hpp"
+
+namespace GameSolver {
+namespace Connect4 {
+
+/**
+ * Small cache of the column scores of the last solved positions, so that a repeated
+ * query is answered without any search, even after its entries left the transposition table.
+ *
+ * A position and its mirror image share the same entry (see BasicPosition::symmetricKey),
+ * column scores being stored for the orientation of the smallest key.
+ * When the cache is full the least recently used entry is replaced.
+ *
+ * Scores are the ones of getColumnScores: exact scores, or only -1, 0, 1 for wins, draws
+ * and losses when the entry is not exact. Columns that cannot be the best one may be
+ * stored with -100.
+ */
+template<class P, int size = 32>
+class AnswerCache {
+  using position_t = typename P::position_t;
+
+  struct Entry {
+    position_t key;         // 0 for an empty entry (no valid position has key 0)
+    unsigned int lastUse;   // value of clock at the last use of the entry, 0 if empty
+    bool exact;
+    signed char scores[P::WIDTH];
+  };
+
+  Entry entries[size];
+  unsigned int clock;
+  unsigned long long hits, misses;
+
+ public:
+  AnswerCache() {
+    reset();
+  }
+
+  void reset() {
+    for(int i = 0; i < size; i++) {
+      entries[i].key = 0;
+      entries[i].lastUse = 0;
+    }
+    clock = 0;
+    hits = misses = 0;
+  }
+
+  /**
+   * Get the column scores of a position.
+   * @param exact: only accept exact scores, else win/draw/loss scores are enough.
+   * @return true if found, scores are then set for all columns of the position and exact
+   *         tells if they are exact scores.
+   */
+  bool get(const P &pos, int *scores, bool &exact) {
+    bool mirrored;
+    const position_t key = pos.symmetricKey(mirrored);
+    for(int i = 0; i < size; i++)
+      if(entries[i].key == key && (entries[i].exact || !exact)) {
+        Entry &e = entries[i];
+        e.lastUse = ++clock;
+        exact = e.exact;
+        for(int c = 0; c < P::WIDTH; c++) scores[c] = e.scores[mirrored ? P::WIDTH - 1 - c : c];
+        hits++;
+        return true;
+      }
+    misses++;
+    return false;
+  }
+
+  // true if get() would find P (the statistics and the order of the entries are unchanged)
+  bool contains(const P &pos, bool exact) const {
+    bool mirrored;
+    const position_t key = pos.symmetricKey(mirrored);
+    for(int i = 0; i < size; i++)
+      if(entries[i].key == key && (entries[i].exact || !exact)) return true;
+    return false;
+  }
+
+  /**
+   * Store the column scores of a position, replacing any previous entry of the position.
+   */
+  void put(const P &pos, const int *scores, bool exact) {
+    bool mirrored;
+    const position_t key = pos.symmetricKey(mirrored);
+    Entry *e = &entries[0];
+    for(int i = 0; i < size; i++) {
+      if(entries[i].key == key) { e = &entries[i]; break; }
+      if(entries[i].lastUse < e->lastUse) e = &entries[i]; // least recently used entry, empty ones first
+    }
+    e->key = key;
+    e->lastUse = ++clock;
+    e->exact = exact;
+    for(int c = 0; c < P::WIDTH; c++) e->scores[mirrored ? P::WIDTH - 1 - c : c] = scores[c];
+  }
+
+  unsigned long long getHits() const { return hits; }
+  unsigned long long getMisses() const { return misses; }
+};
+
+} // namespace Connect4
+} // namespace GameSolver
+#endif
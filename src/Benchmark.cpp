@@ -0,0 +1,1483 @@
+// -----------------------------------------------------------------------------
+// Connect 4 solver on bare metal Raspberry Pi Zero
+// Copyright (C) 2019 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+// Benchmarks for the solver building blocks (x86 or any hosted build).
+// usage: connect4-bench <mode> [args]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "Solver.hpp"
+#include "ProofSolver.hpp"
+#include "ParallelProbes.hpp"
+#include "EffortModel.hpp"
+#include "perfcount.h"
+
+using namespace GameSolver::Connect4;
+
+// the solver expects these from the board support code (see main.c)
+extern "C" void act_led(int on) {}
+extern "C" void uart_write(const char *s, unsigned int n) {}
+
+
+static double timeInSeconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+// simple deterministic random generator so that runs are comparable across builds
+static unsigned int benchSeed = 12345;
+static unsigned int benchRand()
+{
+  benchSeed = benchSeed * 1103515245 + 12345;
+  return (benchSeed >> 16) & 0x7fff;
+}
+
+
+static bool streq(const char *a, const char *b)
+{
+  while( *a && *a==*b ) { a++; b++; }
+  return *a==*b;
+}
+
+
+// random raw bitboards (position of the player to move, mask) reached by random play
+struct RawBoard { uint64_t position, mask; };
+
+static int randomRawBoards(RawBoard *boards, int n)
+{
+  const int W = Position::WIDTH, H = Position::HEIGHT;
+  for(int i = 0; i < n; i++)
+    {
+      uint64_t pos = 0, mask = 0;
+      int height[W] = {0};
+      int moves = benchRand() % (W * H);
+      for(int m = 0; m < moves; m++)
+        {
+          int col = benchRand() % W;
+          if( height[col] == H ) continue;
+          uint64_t bit = UINT64_C(1) << (col * (H + 1) + height[col]++);
+          pos ^= mask;  // switch player
+          mask |= bit;
+        }
+      boards[i].position = pos;
+      boards[i].mask = mask;
+    }
+  return n;
+}
+
+
+template<class F>
+static double timeKernel(const char *name, F kernel, int iterations)
+{
+  unsigned long long check = 0;
+  double t = timeInSeconds();
+  for(int i = 0; i < iterations; i++) check += kernel(i);
+  t = timeInSeconds() - t;
+  printf("  %-28s %8.2f ns/op   (check %llu)\n", name, t * 1e9 / iterations, check);
+  return t;
+}
+
+
+// compare all popcount and winning-position kernels for equivalence and speed
+static int benchKernels(int argc, char **argv)
+{
+  const int N = 1 << 16;
+  const int iterations = argc > 0 ? atoi(argv[0]) : 20000000;
+  const int H = Position::HEIGHT;
+  static RawBoard boards[N];
+  randomRawBoards(boards, N);
+
+  uint64_t board_mask = 0, bottom_mask = 0;
+  for(int c = 0; c < Position::WIDTH; c++)
+    {
+      board_mask |= ((UINT64_C(1) << H) - 1) << c * (H + 1);
+      bottom_mask |= UINT64_C(1) << c * (H + 1);
+    }
+
+  // equivalence
+  int errors = 0;
+  for(int i = 0; i < N; i++)
+    {
+      uint64_t p = boards[i].position, m = boards[i].mask;
+      uint64_t w = Bitboard::winning_position_generic<H>(p, m, board_mask);
+      if( Bitboard::winning_position_split32<H>(p, m, board_mask) != w ) errors++;
+      unsigned int c = Bitboard::popcount_loop(w);
+      if( Bitboard::popcount_split32(w) != c || Bitboard::popcount_builtin(w) != c ) errors++;
+      if( Bitboard::popcount_loop(p) != Bitboard::popcount_split32(p) || Bitboard::popcount_loop(p) != Bitboard::popcount_builtin(p) ) errors++;
+    }
+  printf("kernel equivalence on %i boards: %s (%i errors)\n", N, errors ? "FAILED" : "ok", errors);
+
+  printf("popcount:\n");
+  timeKernel("loop",    [&](int i) { return Bitboard::popcount_loop(boards[i & (N - 1)].mask); }, iterations);
+  timeKernel("split32", [&](int i) { return Bitboard::popcount_split32(boards[i & (N - 1)].mask); }, iterations);
+  timeKernel("builtin", [&](int i) { return Bitboard::popcount_builtin(boards[i & (N - 1)].mask); }, iterations);
+
+  printf("winning position:\n");
+  timeKernel("generic", [&](int i) { const RawBoard &b = boards[i & (N - 1)]; return Bitboard::winning_position_generic<H>(b.position, b.mask, board_mask); }, iterations);
+  timeKernel("split32", [&](int i) { const RawBoard &b = boards[i & (N - 1)]; return Bitboard::winning_position_split32<H>(b.position, b.mask, board_mask); }, iterations);
+
+  // move scores of all the playable cells of each board
+  static uint64_t moves[N][Position::WIDTH];
+  static int nbMoves[N];
+  for(int i = 0; i < N; i++)
+    {
+      uint64_t possible = (boards[i].mask + bottom_mask) & board_mask;
+      nbMoves[i] = 0;
+      for(int c = 0; c < Position::WIDTH; c++)
+        if( uint64_t m = possible & uint64_t(Position::column_mask(c)) ) moves[i][nbMoves[i]++] = m;
+    }
+  int scalar[Position::WIDTH], batch[Position::WIDTH];
+  int scoreErrors = 0;
+  for(int i = 0; i < N; i++)
+    {
+      const RawBoard &b = boards[i];
+      Bitboard::move_scores_scalar<H>(b.position, b.mask, board_mask, moves[i], nbMoves[i], scalar);
+      Bitboard::move_scores<H>(b.position, b.mask, board_mask, moves[i], nbMoves[i], batch);
+      for(int j = 0; j < nbMoves[i]; j++) if( scalar[j] != batch[j] ) scoreErrors++;
+    }
+  printf("move scores equivalence: %s (%i errors)\n", scoreErrors ? "FAILED" : "ok", scoreErrors);
+  errors += scoreErrors;
+
+  printf("move scores (all moves of a position):\n");
+  timeKernel("scalar", [&](int i) { const RawBoard &b = boards[i & (N - 1)];
+      Bitboard::move_scores_scalar<H>(b.position, b.mask, board_mask, moves[i & (N - 1)], nbMoves[i & (N - 1)], scalar); return scalar[0]; }, iterations / 4);
+  timeKernel("batched", [&](int i) { const RawBoard &b = boards[i & (N - 1)];
+      Bitboard::move_scores<H>(b.position, b.mask, board_mask, moves[i & (N - 1)], nbMoves[i & (N - 1)], batch); return batch[0]; }, iterations / 4);
+
+  // transposition table index: 64-bit modulo by the prime number of buckets of the solver's
+  // table, against the reduction by machine words of 32-bit targets (see word_mod)
+  constexpr size_t buckets = next_prime((1 << 24) / 2); // TABLE_SIZE 24, 2-entry buckets
+  int indexErrors = 0;
+  for(int i = 0; i < N; i++)
+    {
+      uint64_t key = boards[i].position + boards[i].mask;
+      if( word_mod<buckets, uint32_t>(key) != key % buckets || word_mod<buckets>(key) != key % buckets ) indexErrors++;
+    }
+  printf("table index equivalence: %s (%i errors)\n", indexErrors ? "FAILED" : "ok", indexErrors);
+  errors += indexErrors;
+
+  printf("table index (key %% %llu):\n", (unsigned long long) buckets);
+  timeKernel("64-bit modulo", [&](int i) { const RawBoard &b = boards[i & (N - 1)]; return (b.position + b.mask) % buckets; }, iterations);
+  timeKernel("32-bit words",  [&](int i) { const RawBoard &b = boards[i & (N - 1)]; return word_mod<buckets, uint32_t>(b.position + b.mask); }, iterations);
+
+  return errors ? 1 : 0;
+}
+
+
+// solve a position (empty board by default) with the solver for a board size
+template<int width, int height>
+static int benchBoard(const char *moves)
+{
+  BasicSolver<width, height> *solver = new BasicSolver<width, height>;
+  typename BasicSolver<width, height>::Position P;
+  if( !P.play(moves) )
+    {
+      printf("invalid position for %ix%i board: %s\n", width, height, moves);
+      return 1;
+    }
+
+  double t = timeInSeconds();
+  int score = solver->solve(P);
+  t = timeInSeconds() - t;
+  printf("%ix%i board \"%s\": score %i, %llu nodes, %.3f s, %.0f knodes/s\n",
+         width, height, moves, score, solver->getNodeCount(), t, solver->getNodeCount() / t / 1000);
+  delete solver;
+  return 0;
+}
+
+static int benchBoards(int argc, char **argv)
+{
+  int width, height;
+  const char *moves = argc > 1 ? argv[1] : "";
+  if( argc < 1 || sscanf(argv[0], "%ix%i", &width, &height) != 2 ) width = 6, height = 5;
+
+  if( width==6 && height==5 ) return benchBoard<6, 5>(moves);
+  if( width==7 && height==6 ) return benchBoard<7, 6>(moves);
+  if( width==8 && height==7 ) return benchBoard<8, 7>(moves);
+  if( width==9 && height==7 ) return benchBoard<9, 7>(moves);
+  printf("unsupported board size %ix%i\n", width, height);
+  return 1;
+}
+
+
+// random position reached by playing n random moves, none of them winning
+static bool randomPosition(int n, char *moves, Position &P)
+{
+  P = Position();
+  for(int i = 0; i < n; i++)
+    {
+      int tries = 0, col;
+      do { col = benchRand() % Position::WIDTH; }
+      while( (!P.canPlay(col) || P.isWinningMove(col)) && ++tries < 100 );
+      if( tries == 100 ) return false;
+      P.playCol(col);
+      moves[i] = '1' + col;
+    }
+  moves[n] = 0;
+  return true;
+}
+
+
+// corpus of random positions, all after the same number of moves
+static int randomCorpus(int count, int depth, char (*moves)[64], Position *positions)
+{
+  for(int i = 0; i < count; )
+    if( randomPosition(depth, moves[i], positions[i]) ) i++;
+  return count;
+}
+
+
+// replay a corpus of games with a board backend, doing at each move the work of a search node:
+// non losing moves, their scores and the key of the position
+template<class P>
+static unsigned long long replayGames(char (*games)[64], int count)
+{
+  unsigned long long check = 0;
+  for(int g = 0; g < count; g++)
+    {
+      P pos;
+      for(const char *m = games[g]; *m; m++)
+        {
+          const typename P::position_t next = pos.possibleNonLosingMoves();
+          for(int c = 0; c < P::WIDTH; c++)
+            if( const typename P::position_t move = next & P::column_mask(c) ) check += pos.moveScore(move);
+          check += uint64_t(pos.key()) & 0xffff;
+          pos.playCol(*m - '1');
+        }
+    }
+  return check;
+}
+
+template<class P>
+static unsigned long long timeBackend(const char *name, char (*games)[64], int count, int depth, int passes)
+{
+  unsigned long long check = 0;
+  double t = timeInSeconds();
+  for(int i = 0; i < passes; i++) check += replayGames<P>(games, count);
+  t = timeInSeconds() - t;
+  printf("  %-28s %8.2f ns/move (check %llu)\n", name, t * 1e9 / passes / count / depth, check);
+  return check;
+}
+
+// compare the bitboard backends of Position (64-bit integers and two 32-bit words)
+static int benchBackends(int argc, char **argv)
+{
+  const int passes = argc > 0 ? atoi(argv[0]) : 200;
+  const int count = 1000, depth = 30;
+  char (*games)[64] = new char[count][64];
+  Position *positions = new Position[count];
+  randomCorpus(count, depth, games, positions);
+
+  printf("%i random %i-move games:\n", count, depth);
+  unsigned long long c64 = timeBackend<BasicPosition<7, 6, uint64_t>>("uint64_t", games, count, depth, passes);
+  unsigned long long c32 = timeBackend<BasicPosition<7, 6, Bitboard::SplitBoard>>("SplitBoard (2 x 32 bits)", games, count, depth, passes);
+  printf("backend equivalence: %s\n", c64 != c32 ? "FAILED" : "ok");
+
+  delete[] games;
+  delete[] positions;
+  return c64 != c32 ? 1 : 0;
+}
+
+
+// time the primitives of Position and the book probes on random positions, the checks
+// (sums of the results) are the same on every build and backend
+static int benchPrimitives(int argc, char **argv)
+{
+  const int N = 1 << 12;
+  const int iterations = argc > 0 ? atoi(argv[0]) : 10000000;
+  static Position positions[N];
+  static Position::position_t moves[N]; // a non losing move of each position (0 if none)
+  static int columns[N];                // a playable column of each position
+  char seq[64];
+
+  for(int i = 0; i < N; i++)
+    {
+      while( !randomPosition(benchRand() % 36, seq, positions[i]) );
+      const Position &P = positions[i];
+      Position::position_t next = P.possibleNonLosingMoves();
+      moves[i] = next & (~next + 1);
+      do { columns[i] = benchRand() % Position::WIDTH; } while( !P.canPlay(columns[i]) );
+    }
+
+  printf("position primitives (%i random positions, 0 to 35 moves):\n", N);
+  timeKernel("play (column)", [&](int i) { Position P = positions[i & (N - 1)]; P.playCol(columns[i & (N - 1)]); return uint64_t(P.key()); }, iterations);
+  timeKernel("play (move)", [&](int i) { Position P = positions[i & (N - 1)]; P.play(moves[i & (N - 1)]); return uint64_t(P.key()); }, iterations);
+  timeKernel("possibleNonLosingMoves", [&](int i) { return uint64_t(positions[i & (N - 1)].possibleNonLosingMoves()); }, iterations);
+  timeKernel("moveScore", [&](int i) { return positions[i & (N - 1)].moveScore(moves[i & (N - 1)]); }, iterations);
+  timeKernel("isWinningMove", [&](int i) { return positions[i & (N - 1)].isWinningMove(columns[i & (N - 1)]); }, iterations);
+  timeKernel("key", [&](int i) { return uint64_t(positions[i & (N - 1)].key()); }, iterations);
+  timeKernel("key3", [&](int i) { return positions[i & (N - 1)].key3(); }, iterations / 4);
+  timeKernel("getHuffman", [&](int i) { int h, m; positions[i & (N - 1)].getHuffman(h, m); return unsigned(h) + unsigned(m); }, iterations / 4);
+
+  // book probes on positions at the depth of each book (half of them mirrored)
+  Solver::Books books;
+  books.book.loadFile("book.dat");
+  books.book12.loadFile("book12.dat");
+  books.books.loadFile("books.c4b");
+  const struct { const char *name; int depth; } probes[3] =
+    { { "book.dat", books.book.maxDepth() }, { "book12.dat", books.book12.ok() ? 12 : -1 }, { "books.c4b", books.books.maxDepth() } };
+
+  printf("book probes:\n");
+  for(int b = 0; b < 3; b++)
+    {
+      char name[64];
+      sprintf(name, "%s (%i moves)", probes[b].name, probes[b].depth);
+      if( probes[b].depth < 0 ) { printf("  %-28s not loaded\n", probes[b].name); continue; }
+      for(int i = 0; i < N; i++) while( !randomPosition(probes[b].depth, seq, positions[i]) );
+      timeKernel(name, [&](int i) { const Position &P = positions[i & (N - 1)];
+          return b == 0 ? books.book.get(P) : b == 1 ? books.book12.get(P) : books.books.get(P); }, iterations / 20);
+    }
+  return 0;
+}
+
+
+// number of move sequences of depth moves from P, games ending at the first alignment
+template<class P>
+static unsigned long long perft(const P &pos, int depth)
+{
+  if( depth == 0 ) return 1;
+  unsigned long long n = 0;
+  for(int c = 0; c < P::WIDTH; c++)
+    if( pos.canPlay(c) )
+      {
+        if( depth == 1 ) n++;
+        else if( !pos.isWinningMove(c) ) // the game is over after an alignment
+          {
+            P pos2 = pos;
+            pos2.playCol(c);
+            n += perft(pos2, depth - 1);
+          }
+      }
+  return n;
+}
+
+
+// same count on a plain array of cells, as a reference for the bitboards
+struct ArrayBoard {
+  int cells[Position::WIDTH][Position::HEIGHT]; // 0 empty, 1 and 2 the players
+  int heights[Position::WIDTH];
+  int player;
+
+  // true if the stone in column c completes an alignment
+  bool aligned(int c) const
+  {
+    static const int directions[4][2] = { {1, 0}, {0, 1}, {1, 1}, {1, -1} };
+    const int r = heights[c] - 1, p = cells[c][r];
+    for(int d = 0; d < 4; d++)
+      {
+        int n = 1;
+        for(int s = -1; s <= 1; s += 2)
+          for(int x = c + s * directions[d][0], y = r + s * directions[d][1];
+              x >= 0 && x < Position::WIDTH && y >= 0 && y < Position::HEIGHT && cells[x][y] == p;
+              x += s * directions[d][0], y += s * directions[d][1]) n++;
+        if( n >= 4 ) return true;
+      }
+    return false;
+  }
+
+  unsigned long long perft(int depth)
+  {
+    if( depth == 0 ) return 1;
+    unsigned long long n = 0;
+    for(int c = 0; c < Position::WIDTH; c++)
+      if( heights[c] < Position::HEIGHT )
+        {
+          cells[c][heights[c]++] = player;
+          if( depth == 1 ) n++;
+          else if( !aligned(c) )
+            {
+              player = 3 - player;
+              n += perft(depth - 1);
+              player = 3 - player;
+            }
+          cells[c][--heights[c]] = 0;
+        }
+    return n;
+  }
+};
+
+
+// count the move sequences from a position (default: the empty board) for each depth up to
+// maxDepth with the bitboards, checked against the array board up to checkDepth
+static int benchPerft(int argc, char **argv)
+{
+  const int maxDepth = argc > 0 ? atoi(argv[0]) : 9;
+  const int checkDepth = argc > 1 ? atoi(argv[1]) : 8;
+  const char *moves = argc > 2 ? argv[2] : "";
+  Position P;
+  ArrayBoard A = {};
+  A.player = 1;
+  for(int i = 0; moves[i]; i++)
+    {
+      int c = moves[i] - '1';
+      if( c < 0 || c >= Position::WIDTH || !P.canPlay(c) || P.isWinningMove(c) ) { printf("invalid moves %s\n", moves); return 1; }
+      P.playCol(c);
+      A.cells[c][A.heights[c]++] = A.player;
+      A.player = 3 - A.player;
+    }
+
+  int errors = 0;
+  printf("%5s %16s %10s %10s\n", "depth", "sequences", "s", "Mseq/s");
+  for(int depth = 1; depth <= maxDepth; depth++)
+    {
+      double t = timeInSeconds();
+      unsigned long long n = perft(P, depth);
+      t = timeInSeconds() - t;
+      printf("%5i %16llu %10.3f %10.1f", depth, n, t, n / t / 1e6);
+      if( depth <= checkDepth )
+        {
+          unsigned long long m = A.perft(depth);
+          if( m != n ) errors++;
+          printf("  %s", m == n ? "ok" : "MISMATCH");
+          if( m != n ) printf(" (array board: %llu)", m);
+        }
+      printf("\n");
+    }
+  return errors ? 1 : 0;
+}
+
+
+// compare the root drivers of Solver::solve on a corpus of random positions
+static int benchDrivers(int argc, char **argv)
+{
+  const int count = argc > 0 ? atoi(argv[0]) : 20;
+  const int depth = argc > 1 ? atoi(argv[1]) : 13;
+  char (*moves)[64] = new char[count][64];
+  Position *positions = new Position[count];
+  randomCorpus(count, depth, moves, positions);
+
+  Solver *solver = new Solver;
+  solver->getBook().loadFile("book.dat");
+  solver->getBook12().loadFile("book12.dat");
+
+  // guess sources: none, the exact score (as known from a previous query)
+  static const char *names[3] = { "bisection", "mtdf, no guess", "mtdf, previous query" };
+  unsigned long long nodes[3] = {0}, probes[3] = {0};
+  double times[3] = {0};
+  int errors = 0;
+
+  for(int i = 0; i < count; i++)
+    {
+      int exact = 0;
+      for(int d = 0; d < 3; d++)
+        {
+          int guess = d==2 ? exact : Solver::NO_GUESS;
+          solver->reset();
+          solver->setDriver(d==0 ? Solver::BISECTION : Solver::MTDF);
+          double t = timeInSeconds();
+          int score = solver->solve(positions[i], false, guess);
+          times[d] += timeInSeconds() - t;
+          nodes[d] += solver->getNodeCount();
+          probes[d] += solver->getProbeCount();
+          if( d==0 ) exact = score;
+          else if( score != exact ) { errors++; printf("score mismatch for %s: %i vs %i\n", moves[i], score, exact); }
+        }
+    }
+
+  printf("%i random %i-ply positions:\n", count, depth);
+  for(int d = 0; d < 3; d++)
+    printf("  %-22s %6llu probes %12llu nodes %8.2f s\n", names[d], probes[d], nodes[d], times[d]);
+
+  delete solver;
+  delete[] positions;
+  delete[] moves;
+  return errors ? 1 : 0;
+}
+
+
+// check the static threat rules against exact scores and compare node counts with and without them
+static int benchRules(int argc, char **argv)
+{
+  const int count = argc > 0 ? atoi(argv[0]) : 20;
+  const int depth = argc > 1 ? atoi(argv[1]) : 14;
+  char (*moves)[64] = new char[count][64];
+  Position *positions = new Position[count];
+  randomCorpus(count, depth, moves, positions);
+
+  Solver *solver = new Solver;
+  solver->getBook().loadFile("book.dat");
+  solver->getBook12().loadFile("book12.dat");
+  const bool haveBook12 = solver->getBook12().ok();
+
+  // soundness: every position where the rules apply must have a score <= 0, checked on count
+  // positions where they apply. The rules need an even number of empty cells and rarely apply
+  // before the late middle game: random 28..38-ply positions are sampled, as well as 12-move
+  // ones, checked against the 12-move book when available (others by search).
+  const int samples = count * 1000;
+  int tested = 0, errors = 0;
+  for(int i = 0; i < samples && tested < count; i++)
+    {
+      char m[64];
+      Position P;
+      int d = i % 8 == 0 ? 12 : 28 + 2 * (i % 6); // even depths 12 and 28..38
+      if( !randomPosition(d, m, P) || P.canWinNext() || !ThreatRules<Position>::cannotWin(P) ) continue;
+      tested++;
+      int score = d == 12 && haveBook12 ? solver->bookScore(P) : Solver::NO_GUESS;
+      if( score == Solver::NO_GUESS )
+        {
+          solver->reset();
+          solver->setRules(false);
+          score = solver->solve(P, true);
+        }
+      if( score > 0 ) { errors++; printf("rules claim a draw bound for %s but score is %i\n", m, score); }
+    }
+  if( tested == 0 )
+    {
+      errors++;
+      printf("rules never applied to %i random positions, soundness not tested\n", samples);
+    }
+  else
+    printf("soundness tested on %i positions where the rules apply (%s): %s, %i errors\n", tested,
+           haveBook12 ? "book12.dat + search" : "search only, no book12.dat", errors ? "FAILED" : "passed", errors);
+
+  unsigned long long nodes[2] = {0};
+  double times[2] = {0};
+  for(int i = 0; i < count; i++)
+    {
+      int scores[2];
+      for(int r = 0; r < 2; r++)
+        {
+          solver->reset();
+          solver->setRules(r == 1);
+          double t = timeInSeconds();
+          scores[r] = solver->solve(positions[i]);
+          times[r] += timeInSeconds() - t;
+          nodes[r] += solver->getNodeCount();
+        }
+      if( scores[0] != scores[1] ) { errors++; printf("score mismatch for %s: %i vs %i\n", moves[i], scores[1], scores[0]); }
+    }
+
+  printf("%i random %i-ply positions:\n", count, depth);
+  printf("  %-12s %12llu nodes %8.2f s\n", "search", nodes[0], times[0]);
+  printf("  %-12s %12llu nodes %8.2f s\n", "with rules", nodes[1], times[1]);
+
+  delete solver;
+  delete[] positions;
+  delete[] moves;
+  return errors ? 1 : 0;
+}
+
+
+// compare the recursive and iterative engines, and the iterative one run in time slices
+static int benchEngines(int argc, char **argv)
+{
+  const int count = argc > 0 ? atoi(argv[0]) : 20;
+  const int depth = argc > 1 ? atoi(argv[1]) : 14;
+  const unsigned long long slice = argc > 2 ? atoi(argv[2]) : 10000;
+  char (*moves)[64] = new char[count][64];
+  Position *positions = new Position[count];
+  randomCorpus(count, depth, moves, positions);
+
+  Solver *solver = new Solver;
+  solver->getBook().loadFile("book.dat");
+  solver->getBook12().loadFile("book12.dat");
+
+  static const char *names[3] = { "recursive", "iterative", "iterative, sliced" };
+  unsigned long long nodes[3] = {0}, slices = 0;
+  double times[3] = {0};
+  int errors = 0;
+
+  for(int i = 0; i < count; i++)
+    {
+      int scores[3];
+      unsigned long long n[3];
+      for(int e = 0; e < 3; e++)
+        {
+          solver->reset();
+          solver->setEngine(e == 0 ? Solver::RECURSIVE : Solver::ITERATIVE);
+          double t = timeInSeconds();
+          if( e < 2 )
+            scores[e] = solver->solve(positions[i]);
+          else
+            {
+              solver->startSolve(positions[i]);
+              while( !solver->resumeSolve(slice, scores[e]) ) slices++;
+              slices++;
+            }
+          times[e] += timeInSeconds() - t;
+          n[e] = solver->getNodeCount();
+          nodes[e] += n[e];
+        }
+      if( scores[1] != scores[0] || scores[2] != scores[0] || n[1] != n[0] || n[2] != n[0] )
+        { errors++; printf("engines differ for %s: %i %i %i\n", moves[i], scores[0], scores[1], scores[2]); }
+    }
+
+  printf("%i random %i-ply positions (%llu slices of %llu nodes):\n", count, depth, slices, slice);
+  for(int e = 0; e < 3; e++)
+    printf("  %-18s %12llu nodes %8.2f s %8.0f knodes/s\n", names[e], nodes[e], times[e], nodes[e] / times[e] / 1000);
+
+  delete solver;
+  delete[] positions;
+  delete[] moves;
+  return errors ? 1 : 0;
+}
+
+
+// compare the number of empty cells below which the table-free endgame search is used,
+// on late positions and on full solves of earlier ones
+static int benchEndgame(int argc, char **argv)
+{
+  const int lateCount = argc > 0 ? atoi(argv[0]) : 1000;
+  const int count = argc > 1 ? atoi(argv[1]) : 20;
+  static const int cells[] = { 0, 6, 8, 10, 12, 14 };
+  const int nbCells = sizeof(cells) / sizeof(cells[0]);
+
+  Solver *solver = new Solver;
+  solver->setRules(true); // as solver_init
+  solver->getBook().loadFile("book.dat");
+  solver->getBook12().loadFile("book12.dat");
+
+  int errors = 0;
+  for(int set = 0; set < 2; set++)
+    {
+      const int n = set == 0 ? lateCount : count;
+      const int depth = set == 0 ? 30 : 14;
+      char (*moves)[64] = new char[n][64];
+      Position *positions = new Position[n];
+      int *scores = new int[n];
+      randomCorpus(n, depth, moves, positions);
+
+      printf("%i random %i-ply positions:\n", n, depth);
+      for(int c = 0; c < nbCells; c++)
+        {
+          unsigned long long nodes = 0;
+          double t = 0;
+          solver->setEndgameCells(cells[c]);
+          for(int i = 0; i < n; i++)
+            {
+              solver->reset();
+              double t0 = timeInSeconds();
+              int score = solver->solve(positions[i]);
+              t += timeInSeconds() - t0;
+              nodes += solver->getNodeCount();
+              if( c == 0 ) scores[i] = score;
+              else if( score != scores[i] ) { errors++; printf("score mismatch for %s: %i vs %i\n", moves[i], score, scores[i]); }
+            }
+          printf("  endgame below %2i empty cells %12llu nodes %8.3f s %8.0f knodes/s\n", cells[c], nodes, t, nodes / t / 1000);
+        }
+
+      delete[] scores;
+      delete[] positions;
+      delete[] moves;
+    }
+
+  delete solver;
+  return errors ? 1 : 0;
+}
+
+
+// a thread solving a list of queries with its own solver instance
+struct InstanceJob {
+  solver_t *solver;
+  int count;
+  char (*moves)[64];
+  char (*answers)[5];
+};
+
+static void *instanceThread(void *arg)
+{
+  InstanceJob *job = (InstanceJob *) arg;
+  for(int i = 0; i < job->count; i++)
+    if( solver_solve_r(job->solver, job->moves[i], 0, job->answers[i], NULL) == NULL ) job->answers[i][0] = 0;
+  return NULL;
+}
+
+// solve the same random positions with one solver instance per thread and compare the
+// scores with the ones of a single instance
+static int benchInstances(int argc, char **argv)
+{
+  const int threads = argc > 0 ? atoi(argv[0]) : 4;
+  const int count = argc > 1 ? atoi(argv[1]) : 10;
+  const int depth = argc > 2 ? atoi(argv[2]) : 14;
+  char (*moves)[64] = new char[count][64];
+  Position *positions = new Position[count];
+  randomCorpus(count, depth, moves, positions);
+
+  InstanceJob *jobs = new InstanceJob[threads + 1];
+  pthread_t *ids = new pthread_t[threads];
+  for(int t = 0; t <= threads; t++)
+    {
+      solver_config config = { 7, 6, (unsigned int) t + 1, NULL, NULL, 0 };
+      jobs[t].solver = solver_create(&config);
+      jobs[t].count = count;
+      jobs[t].moves = moves;
+      jobs[t].answers = new char[count][5];
+    }
+
+  double t0 = timeInSeconds();
+  instanceThread(&jobs[threads]); // reference answers
+  double single = timeInSeconds() - t0;
+
+  t0 = timeInSeconds();
+  for(int t = 0; t < threads; t++) pthread_create(&ids[t], NULL, instanceThread, &jobs[t]);
+  for(int t = 0; t < threads; t++) pthread_join(ids[t], NULL);
+  double parallel = timeInSeconds() - t0;
+
+  int errors = 0;
+  for(int t = 0; t < threads; t++)
+    for(int i = 0; i < count; i++)
+      if( !streq(jobs[t].answers[i] + 1, jobs[threads].answers[i] + 1) ) // the column may differ between equally good ones
+        {
+          printf("instance %i: %s answered %s instead of %s\n", t, moves[i], jobs[t].answers[i], jobs[threads].answers[i]);
+          errors++;
+        }
+
+  printf("%i random %i-ply positions: %.3f s with one instance, %.3f s with %i instances in parallel threads, %i errors\n",
+         count, depth, single, parallel, threads, errors);
+
+  for(int t = 0; t <= threads; t++)
+    {
+      solver_destroy(jobs[t].solver);
+      delete[] jobs[t].answers;
+    }
+  delete[] ids;
+  delete[] jobs;
+  delete[] positions;
+  delete[] moves;
+  return errors ? 1 : 0;
+}
+
+
+// solve a position recording a trace of the search (solver built with -DSOLVER_TRACE)
+static int benchTrace(int argc, char **argv)
+{
+#ifdef SOLVER_TRACE
+  if( argc < 1 ) { printf("trace: missing trace file\n"); return 1; }
+  const char *moves = argc > 1 ? argv[1] : "";
+  Position P;
+  if( !P.play(moves) || P.canWinNext() ) { printf("invalid position: %s\n", moves); return 1; }
+
+  Solver *solver = new Solver;
+  solver->setRules(true); // as solver_init
+  solver->getBook().loadFile("book.dat");
+  solver->getBook12().loadFile("book12.dat");
+  if( !solver->getTrace().open(argv[0], Position::WIDTH, Position::HEIGHT) ) { printf("can not write %s\n", argv[0]); return 1; }
+
+  double t = timeInSeconds();
+  int score = solver->solve(P);
+  t = timeInSeconds() - t;
+  solver->getTrace().close();
+  printf("\"%s\": score %i, %llu nodes, %.3f s, %zu events written to %s\n",
+         moves, score, solver->getNodeCount(), t, solver->getTrace().getTotal(), argv[0]);
+  delete solver;
+  return 0;
+#else
+  printf("trace: the solver was built without -DSOLVER_TRACE\n");
+  return 1;
+#endif
+}
+
+
+// time the construction of a solver and the clearing of its transposition table
+static int benchReset(int argc, char **argv)
+{
+  const int count = argc > 0 ? atoi(argv[0]) : 1000;
+  double t = timeInSeconds();
+  Solver *solver = new Solver;
+  printf("solver construction: %.3f ms\n", (timeInSeconds() - t) * 1e3);
+
+  t = timeInSeconds();
+  for(int i = 0; i < count; i++) solver->reset();
+  printf("reset: %.3f ms per call (%i calls)\n", (timeInSeconds() - t) * 1e3 / count, count);
+
+  t = timeInSeconds();
+  for(int i = 0; i < count; i++) solver->newGame();
+  printf("newGame: %.3f ms per call (%i calls)\n", (timeInSeconds() - t) * 1e3 / count, count);
+
+  delete solver;
+  return 0;
+}
+
+
+// compare node counts, speed and cache misses with and without the children probes
+static int benchProbes(int argc, char **argv)
+{
+  const int count = argc > 0 ? atoi(argv[0]) : 20;
+  const int depth = argc > 1 ? atoi(argv[1]) : 14;
+  char (*moves)[64] = new char[count][64];
+  Position *positions = new Position[count];
+  randomCorpus(count, depth, moves, positions);
+
+  Solver *solver = new Solver;
+  solver->getBook().loadFile("book.dat");
+  solver->getBook12().loadFile("book12.dat");
+
+  const int misses = perfcount_open(PERFCOUNT_CACHE_MISSES);
+  const int cycles = perfcount_open(PERFCOUNT_CYCLES);
+  if( misses<0 ) printf("hardware counters not available, only reporting nodes and time\n");
+
+  static const char *names[2] = { "no child probes", "child probes" };
+  unsigned long long nodes[2] = {0}, missCount[2] = {0}, cycleCount[2] = {0};
+  double times[2] = {0};
+  int errors = 0;
+  for(int i = 0; i < count; i++)
+    {
+      int scores[2];
+      for(int c = 0; c < 2; c++)
+        {
+          solver->reset();
+          solver->setChildProbes(c==1);
+          unsigned long long m = perfcount_read(misses), cy = perfcount_read(cycles);
+          double t = timeInSeconds();
+          scores[c] = solver->solve(positions[i]);
+          times[c] += timeInSeconds() - t;
+          missCount[c] += perfcount_read(misses) - m;
+          cycleCount[c] += perfcount_read(cycles) - cy;
+          nodes[c] += solver->getNodeCount();
+        }
+      if( scores[0]!=scores[1] ) { errors++; printf("score mismatch for %s: %i vs %i\n", moves[i], scores[1], scores[0]); }
+    }
+
+  printf("%i random %i-ply positions:\n", count, depth);
+  for(int c = 0; c < 2; c++)
+    {
+      printf("  %-16s %12llu nodes %8.2f s %8.0f knodes/s", names[c], nodes[c], times[c], nodes[c] / times[c] / 1000);
+      if( misses>=0 ) printf(" %6.2f cache misses/node", double(missCount[c]) / nodes[c]);
+      if( cycles>=0 ) printf(" %7.0f cycles/node", double(cycleCount[c]) / nodes[c]);
+      printf("\n");
+    }
+
+  delete solver;
+  delete[] positions;
+  delete[] moves;
+  return errors ? 1 : 0;
+}
+
+
+// compare the single transposition table with the two-level one (near-leaf tier beyond a ply)
+static int benchTiers(int argc, char **argv)
+{
+  const int count = argc > 0 ? atoi(argv[0]) : 20;
+  const int depth = argc > 1 ? atoi(argv[1]) : 14;
+  int plies[8] = { 0, 22, 26, 30 }, nbConfigs = 4; // 0: single table
+  if( argc > 2 )
+    for(nbConfigs = 1; nbConfigs < 8 && nbConfigs < argc - 1; nbConfigs++) plies[nbConfigs] = atoi(argv[nbConfigs + 1]);
+  char (*moves)[64] = new char[count][64];
+  Position *positions = new Position[count];
+  randomCorpus(count, depth, moves, positions);
+
+  Solver *solver = new Solver;
+  solver->getBook().loadFile("book.dat");
+  solver->getBook12().loadFile("book12.dat");
+  solver->setRules(true);
+
+  const int misses = perfcount_open(PERFCOUNT_CACHE_MISSES);
+  if( misses<0 ) printf("hardware counters not available, only reporting nodes, hits and time\n");
+
+  unsigned long long nodes[8] = {0}, missCount[8] = {0}, probes[8][2] = {{0}}, hits[8][2] = {{0}};
+  double times[8] = {0};
+  int errors = 0;
+  for(int i = 0; i < count; i++)
+    {
+      int scores[8];
+      for(int c = 0; c < nbConfigs; c++)
+        {
+          solver->reset();
+          solver->setNearPly(plies[c]);
+          unsigned long long m = perfcount_read(misses);
+          double t = timeInSeconds();
+          scores[c] = solver->solve(positions[i]);
+          times[c] += timeInSeconds() - t;
+          missCount[c] += perfcount_read(misses) - m;
+          nodes[c] += solver->getNodeCount();
+          for(int near = 0; near < 2; near++)
+            {
+              unsigned long long p, h;
+              solver->getTableStats(near, p, h);
+              probes[c][near] += p;
+              hits[c][near] += h;
+            }
+          if( scores[c]!=scores[0] ) { errors++; printf("score mismatch for %s: %i vs %i\n", moves[i], scores[c], scores[0]); }
+        }
+    }
+
+  printf("%i random %i-ply positions, hits of the lookups of the nodes in each table:\n", count, depth);
+  for(int c = 0; c < nbConfigs; c++)
+    {
+      char name[32];
+      if( plies[c] ) sprintf(name, "near from ply %i", plies[c]); else sprintf(name, "single table");
+      printf("  %-18s %12llu nodes %8.2f s %8.0f knodes/s  main %5.1f%%", name, nodes[c], times[c], nodes[c] / times[c] / 1000,
+             probes[c][0] ? 100.0 * hits[c][0] / probes[c][0] : 0.0);
+      if( plies[c] ) printf("  near %5.1f%%", probes[c][1] ? 100.0 * hits[c][1] / probes[c][1] : 0.0);
+      if( misses>=0 ) printf("  %6.2f cache misses/node", double(missCount[c]) / nodes[c]);
+      printf("\n");
+    }
+
+  delete solver;
+  delete[] positions;
+  delete[] moves;
+  return errors ? 1 : 0;
+}
+
+
+// compare win/draw/loss searches: weak negamax, proof-number search and the race of both
+static int benchProof(int argc, char **argv)
+{
+  const int count = argc > 0 ? atoi(argv[0]) : 20;
+  const int depth = argc > 1 ? atoi(argv[1]) : 13;
+  char (*moves)[64] = new char[count][64];
+  Position *positions = new Position[count];
+  randomCorpus(count, depth, moves, positions);
+
+  Solver *solver = new Solver;
+  solver->getBook().loadFile("book.dat");
+  solver->getBook12().loadFile("book12.dat");
+  solver->setRules(true);
+  ProofSolver *proof = new ProofSolver;
+  proof->getBook().loadFile("book.dat");
+  proof->getBook12().loadFile("book12.dat");
+  ProofRace<Solver> race(*solver, *proof);
+
+  static const char *names[3] = { "negamax", "proof-number", "race" };
+  unsigned long long nodes[3] = {0};
+  double times[3] = {0};
+  int errors = 0, proofWins = 0;
+
+  for(int i = 0; i < count; i++)
+    {
+      int scores[3];
+      unsigned long long n[3];
+      for(int e = 0; e < 3; e++)
+        {
+          solver->reset();
+          proof->reset();
+          race.resetNodeCount();
+          double t = timeInSeconds();
+          scores[e] = e == 0 ? solver->solve(positions[i], true) : e == 1 ? proof->solve(positions[i]) : race.solve(positions[i], true);
+          times[e] += timeInSeconds() - t;
+          n[e] = e == 0 ? solver->getNodeCount() : e == 1 ? proof->getNodeCount() : race.getNodeCount();
+          nodes[e] += n[e];
+        }
+      if( n[1] < n[0] ) proofWins++;
+      for(int e = 0; e < 3; e++) scores[e] = scores[e] > 0 ? 1 : scores[e] < 0 ? -1 : 0; // immediate wins are exact
+      if( scores[1] != scores[0] || scores[2] != scores[0] )
+        { errors++; printf("results differ for %s: %i %i %i\n", moves[i], scores[0], scores[1], scores[2]); }
+    }
+
+  printf("%i random %i-ply positions, proof-number search with fewer nodes on %i:\n", count, depth, proofWins);
+  for(int e = 0; e < 3; e++)
+    printf("  %-14s %12llu nodes %8.2f s %8.0f knodes/s\n", names[e], nodes[e], times[e], nodes[e] / times[e] / 1000);
+
+  delete proof;
+  delete solver;
+  delete[] positions;
+  delete[] moves;
+  return errors ? 1 : 0;
+}
+
+
+// compare the probes of each search run one after the other and in parallel threads
+static int benchParallel(int argc, char **argv)
+{
+  const int threads = argc > 0 ? atoi(argv[0]) : 4;
+  const int count = argc > 1 ? atoi(argv[1]) : 20;
+  const int depth = argc > 2 ? atoi(argv[2]) : 14;
+  char (*moves)[64] = new char[count][64];
+  Position *positions = new Position[count];
+  randomCorpus(count, depth, moves, positions);
+
+  Solver *solver = new Solver;
+  solver->getBook().loadFile("book.dat");
+  solver->getBook12().loadFile("book12.dat");
+  solver->setRules(true);
+  ParallelProbes<Solver> parallel(*solver, threads);
+  if( !Solver::SHARED_TABLE ) printf("table entries are not single words (build with -DTABLE_SHARED), probes run one after the other\n");
+
+  unsigned long long nodes[2] = {0};
+  double times[2] = {0};
+  int errors = 0;
+  for(int i = 0; i < count; i++)
+    {
+      int scores[2];
+      for(int p = 0; p < 2; p++)
+        {
+          solver->reset();
+          parallel.resetNodeCount();
+          double t = timeInSeconds();
+          scores[p] = p ? parallel.solve(positions[i]) : solver->solve(positions[i]);
+          times[p] += timeInSeconds() - t;
+          nodes[p] += parallel.getNodeCount();
+        }
+      if( scores[1]!=scores[0] ) { errors++; printf("score mismatch for %s: %i vs %i\n", moves[i], scores[1], scores[0]); }
+    }
+
+  printf("%i random %i-ply positions:\n", count, depth);
+  printf("  %-18s %12llu nodes %8.2f s %8.0f knodes/s\n", "sequential probes", nodes[0], times[0], nodes[0] / times[0] / 1000);
+  printf("  %2i threads         %12llu nodes %8.2f s %8.0f knodes/s  speedup %.2f\n", threads, nodes[1], times[1], nodes[1] / times[1] / 1000, times[0] / times[1]);
+
+  delete solver;
+  delete[] positions;
+  delete[] moves;
+  return errors ? 1 : 0;
+}
+
+
+// random stores then lookups of the keys of 7x6 positions (49 bits) in a table with 2^24 entries
+template<class T>
+static int benchTable(const char *name, const uint64_t *keys, int n, int misses)
+{
+  T *table = new T;
+  unsigned long long m = perfcount_read(misses);
+  double t = timeInSeconds();
+  for(int i = 0; i < n; i++) table->put(keys[i], keys[i] % 127 + 1);
+  double put = timeInSeconds() - t;
+  unsigned long long putMisses = perfcount_read(misses) - m;
+
+  int errors = 0;
+  unsigned long long found = 0;
+  m = perfcount_read(misses);
+  t = timeInSeconds();
+  for(int i = n - 1; i >= 0; i--)
+    if( int v = table->get(keys[i]) )
+      {
+        found++;
+        if( v != int(keys[i] % 127 + 1) ) errors++;
+      }
+  double get = timeInSeconds() - t;
+  unsigned long long getMisses = perfcount_read(misses) - m;
+
+  printf("  %-22s put %6.1f ns get %6.1f ns %5.1f%% found", name, put * 1e9 / n, get * 1e9 / n, 100.0 * found / n);
+  if( misses>=0 ) printf("  cache misses/op put %.2f get %.2f", double(putMisses) / n, double(getMisses) / n);
+  printf("%s\n", errors ? "  WRONG VALUES" : "");
+  delete table;
+  return errors;
+}
+
+// compare the split key/value arrays of the transposition table with packed entries
+static int benchTables(int argc, char **argv)
+{
+  const int n = argc > 0 ? atoi(argv[0]) : 10000000;
+  uint64_t *keys = new uint64_t[n];
+  for(int i = 0; i < n; i++)
+    {
+      keys[i] = 0;
+      for(int j = 0; j < 4; j++) keys[i] = keys[i] << 15 | benchRand();
+      keys[i] &= (UINT64_C(1) << 49) - 1;
+    }
+
+  const int misses = perfcount_open(PERFCOUNT_CACHE_MISSES);
+  if( misses<0 ) printf("hardware counters not available, only reporting time\n");
+
+  printf("%i random keys:\n", n);
+  int errors = 0;
+  errors += benchTable<TranspositionTable<uint32_t, uint64_t, uint8_t, 24>>("split 25+8 bits", keys, n, misses);
+  errors += benchTable<TranspositionTable<uint32_t, uint64_t, uint8_t, 24, 0, 7>>("packed 25+7 bits", keys, n, misses);
+  errors += benchTable<TranspositionTable<uint32_t, uint64_t, uint8_t, 24, 6>>("split, generations", keys, n, misses);
+  errors += benchTable<TranspositionTable<uint64_t, uint64_t, uint8_t, 24, 6, 7>>("packed, generations", keys, n, misses);
+
+  delete[] keys;
+  return errors ? 1 : 0;
+}
+
+
+// search configurations validated by the oracle harness, each one adds an option to the previous one
+struct SearchConfig
+{
+  const char *name;
+  Solver::Driver driver;
+  bool childProbes, rules;
+  Solver::Engine engine;
+};
+
+static const SearchConfig searchConfigs[] = {
+  { "bisection",     Solver::BISECTION, false, false, Solver::RECURSIVE },
+  { "+ mtdf",        Solver::MTDF,      false, false, Solver::RECURSIVE },
+  { "+ child probes",Solver::MTDF,      true,  false, Solver::RECURSIVE },
+  { "+ rules",       Solver::MTDF,      true,  true,  Solver::RECURSIVE },
+  { "+ iterative",   Solver::MTDF,      true,  true,  Solver::ITERATIVE },
+};
+
+
+// solve random 12-move positions without the 12-move book and check the scores against it,
+// for each search configuration
+static int benchOracle(int argc, char **argv)
+{
+  const int count = argc > 0 ? atoi(argv[0]) : 20;
+  const char *bookFile = argc > 1 ? argv[1] : "book12.dat";
+  const int nbConfigs = sizeof(searchConfigs) / sizeof(searchConfigs[0]);
+  char (*moves)[64] = new char[count][64];
+  Position *positions = new Position[count];
+  randomCorpus(count, 12, moves, positions);
+
+  OpeningBook12 oracle(Position::WIDTH, Position::HEIGHT);
+  oracle.loadFile(bookFile);
+  if( !oracle.ok() )
+    printf("%s not found: checking all configurations against the first one only\n", bookFile);
+
+  // the searching solver has no books: 12-move positions are below book.dat and book12 is the oracle
+  Solver *solver = new Solver;
+
+  unsigned long long nodes[nbConfigs] = {0};
+  double times[nbConfigs] = {0};
+  int errors[nbConfigs] = {0};
+  for(int i = 0; i < count; i++)
+    {
+      int expected = oracle.ok() ? oracle.get(positions[i]) + Position::MIN_SCORE - 1 : Solver::NO_GUESS;
+      for(int c = 0; c < nbConfigs; c++)
+        {
+          const SearchConfig &config = searchConfigs[c];
+          solver->reset();
+          solver->setDriver(config.driver);
+          solver->setChildProbes(config.childProbes);
+          solver->setRules(config.rules);
+          solver->setEngine(config.engine);
+          double t = timeInSeconds();
+          int score = solver->solve(positions[i]);
+          times[c] += timeInSeconds() - t;
+          nodes[c] += solver->getNodeCount();
+
+          if( expected==Solver::NO_GUESS ) expected = score;
+          else if( score!=expected )
+            {
+              errors[c]++;
+              printf("%s: wrong score for %s: %i, expected %i\n", config.name, moves[i], score, expected);
+            }
+        }
+    }
+
+  int total = 0;
+  printf("%i random 12-ply positions, %s:\n", count, oracle.ok() ? "checked against the 12-move book" : "cross-checked");
+  for(int c = 0; c < nbConfigs; c++)
+    {
+      printf("  %-16s %3i errors %12llu nodes %8.2f s %8.0f knodes/s\n", searchConfigs[c].name, errors[c], nodes[c], times[c], nodes[c] / times[c] / 1000);
+      total += errors[c];
+    }
+
+  delete solver;
+  delete[] positions;
+  delete[] moves;
+  return total ? 1 : 0;
+}
+
+
+// time repeated queries of n random positions, answered by the cache of answers the second time
+// (the mirror image of the first query being sent for every other position)
+static int benchAnswers(int argc, char **argv)
+{
+  const int count = argc > 0 ? atoi(argv[0]) : 20;
+  const int depth = argc > 1 ? atoi(argv[1]) : 14;
+  char (*moves)[64] = new char[count][64];
+  Position *positions = new Position[count];
+  char (*answers)[5] = new char[count][5];
+  randomCorpus(count, depth, moves, positions);
+
+  int errors = 0;
+  for(int pass = 0; pass < 2; pass++)
+    {
+      unsigned long long nodes = 0, n, hits0, hits;
+      solver_cache_stats(&hits0, NULL);
+      double t = timeInSeconds();
+      for(int i = 0; i < count; i++)
+        {
+          char query[64];
+          for(int j = 0; j <= depth; j++)
+            query[j] = (pass==1 && (i&1) && moves[i][j]) ? '1' + Position::WIDTH - 1 - (moves[i][j] - '1') : moves[i][j];
+
+          const char *res = solver_solve_ex(query, 0, &n);
+          nodes += n;
+          if( pass==0 )
+            { for(int j = 0; j < 5; j++) answers[i][j] = res[j]; }
+          else if( !streq(res + 1, answers[i] + 1) ) // the column may differ between equally good ones
+            {
+              printf("%s: answer %s, first answer %s\n", query, res, answers[i]);
+              errors++;
+            }
+        }
+      t = timeInSeconds() - t;
+      solver_cache_stats(&hits, NULL);
+      printf("pass %i: %i queries, %llu cache hits, %llu nodes, %.1f us per query\n",
+             pass + 1, count, hits - hits0, nodes, t * 1e6 / count);
+    }
+
+  printf("%i errors\n", errors);
+  delete[] moves;
+  delete[] positions;
+  delete[] answers;
+  return errors ? 1 : 0;
+}
+
+
+// compare SOLVER_REFINE answers with exact ones: the refined score must be the exact score,
+// known positions where weak searches returned scores beyond -1 or 1 first
+static int benchRefine(int argc, char **argv)
+{
+  static const char *known[] = { "7535642123422445", "43173473611464155327" };
+  const int count = argc > 0 ? atoi(argv[0]) : 20;
+  int depths[8] = { 16, 20, 24 }, nbDepths = 3;
+  if( argc > 1 )
+    for(nbDepths = 0; nbDepths < 8 && nbDepths < argc - 1; nbDepths++) depths[nbDepths] = atoi(argv[nbDepths + 1]);
+
+  solver_config config = { 7, 6, 1, NULL, NULL, 0 };
+  solver_t *refine = solver_create(&config), *exact = solver_create(&config);
+  int errors = 0, tested = 0;
+  for(int d = -1; d < nbDepths; d++)
+    for(int i = 0; i < (d < 0 ? 2 : count); i++)
+      {
+        char moves[64], r[5], e[5];
+        Position P;
+        if( d < 0 ) sprintf(moves, "%s", known[i]);
+        else while( !randomPosition(depths[d], moves, P) ) ;
+
+        if( solver_solve_r(refine, moves, SOLVER_REFINE, r, NULL)==NULL || solver_solve_r(exact, moves, 0, e, NULL)==NULL ) continue;
+        tested++;
+        if( !streq(r + 1, e + 1) ) // the column may differ between equally good ones
+          {
+            printf("%s: refined answer %s, exact answer %s\n", moves, r, e);
+            errors++;
+          }
+      }
+
+  printf("%i positions, %i errors\n", tested, errors);
+  solver_destroy(refine);
+  solver_destroy(exact);
+  return errors ? 1 : 0;
+}
+
+
+// nodes searched by a query of P: search of all its columns, as getColumnScores in Solver.cpp
+static unsigned long long queryNodes(Solver *solver, const Position &P, bool weak)
+{
+  unsigned long long nodes = 0;
+  for(int c = 0; c < Position::WIDTH; c++)
+    if( P.canPlay(c) && !P.isWinningMove(c) )
+      {
+        Position P2 = P;
+        P2.playCol(c);
+        solver->solve(P2, weak);
+        nodes += solver->getNodeCount();
+      }
+  return nodes;
+}
+
+
+// least squares fit of y = X c (n samples of k features), by the normal equations
+static void fitLeastSquares(const double *X, const double *y, int n, int k, double *c)
+{
+  double A[8][9] = {{0}};
+  for(int s = 0; s < n; s++)
+    for(int i = 0; i < k; i++)
+      {
+        for(int j = 0; j < k; j++) A[i][j] += X[s * k + i] * X[s * k + j];
+        A[i][k] += X[s * k + i] * y[s];
+      }
+
+  // Gaussian elimination with partial pivoting
+  for(int i = 0; i < k; i++)
+    {
+      int p = i;
+      for(int r = i + 1; r < k; r++) if( fabs(A[r][i]) > fabs(A[p][i]) ) p = r;
+      for(int j = 0; j <= k; j++) { double t = A[i][j]; A[i][j] = A[p][j]; A[p][j] = t; }
+      for(int r = 0; r < k; r++)
+        if( r != i && A[i][i] != 0 )
+          {
+            double f = A[r][i] / A[i][i];
+            for(int j = i; j <= k; j++) A[r][j] -= f * A[i][j];
+          }
+    }
+  for(int i = 0; i < k; i++) c[i] = A[i][i] != 0 ? A[i][k] / A[i][i] : 0;
+}
+
+
+// query n random positions from min to max plies (exact and win/draw/loss), fit the coefficients
+// of EffortModel on log2 of their node counts and compare with the built-in ones
+static int benchEffort(int argc, char **argv)
+{
+  typedef EffortModel<Position> Model;
+  const int K = Model::FEATURES;
+  const int count = argc > 0 ? atoi(argv[0]) : 200;
+  const int minDepth = argc > 1 ? atoi(argv[1]) : 14;
+  const int maxDepth = argc > 2 ? atoi(argv[2]) : 30;
+  char moves[64];
+  double *X = new double[count * K], *y[2] = { new double[count], new double[count] };
+  int *builtin[2] = { new int[count], new int[count] };
+
+  Solver *solver = new Solver;
+  solver->getBook().loadFile("book.dat");
+  solver->getBook12().loadFile("book12.dat");
+  solver->setRules(true);
+  Solver::Books books; // for the depth of the books only
+  books.book.loadFile("book.dat");
+  books.book12.loadFile("book12.dat");
+
+  int n = 0;
+  for(int i = 0; i < count; i++)
+    {
+      Position P;
+      int depth = minDepth + i % (maxDepth - minDepth + 1);
+      if( !randomPosition(depth, moves, P) || P.nbMoves() + 1 <= books.depth() ) continue;
+
+      int f[K];
+      Model::features(P, f);
+      for(int j = 0; j < K; j++) X[n * K + j] = f[j];
+      for(int weak = 0; weak < 2; weak++)
+        {
+          solver->reset();
+          y[weak][n] = log2(1.0 + queryNodes(solver, P, weak));
+          builtin[weak][n] = Model::estimate(P, books.depth(), weak);
+        }
+      n++;
+    }
+
+  printf("%i random %i to %i-ply positions, log2 of the node counts of their queries:\n", n, minDepth, maxDepth);
+  for(int weak = 0; weak < 2; weak++)
+    {
+      double c[K];
+      int coefficients[K];
+      fitLeastSquares(X, y[weak], n, K, c);
+      for(int j = 0; j < K; j++) coefficients[j] = (int) lround(c[j] * Model::SCALE);
+
+      // mean absolute error and share of estimates within a factor 4 of the node count
+      double errors[2] = {0};
+      int close[2] = {0};
+      for(int s = 0; s < n; s++)
+        {
+          int f[K];
+          for(int j = 0; j < K; j++) f[j] = (int) X[s * K + j];
+          int e[2] = { builtin[weak][s], Model::estimate(f, coefficients) };
+          for(int m = 0; m < 2; m++)
+            {
+              errors[m] += fabs(e[m] - y[weak][s]);
+              if( fabs(e[m] - y[weak][s]) <= 2 ) close[m]++;
+            }
+        }
+
+      printf("  %s queries:\n", weak ? "win/draw/loss" : "exact");
+      printf("    built-in coefficients: mean error %5.2f, %3i%% within a factor 4\n", errors[0] / n, 100 * close[0] / n);
+      printf("    fitted coefficients:   mean error %5.2f, %3i%% within a factor 4\n", errors[1] / n, 100 * close[1] / n);
+      printf("    fitted: {");
+      for(int j = 0; j < K; j++) printf("%s%i", j ? ", " : "", coefficients[j]);
+      printf("}\n");
+    }
+
+  delete solver;
+  delete[] X;
+  for(int weak = 0; weak < 2; weak++) { delete[] y[weak]; delete[] builtin[weak]; }
+  return 0;
+}
+
+
+static void usage()
+{
+  printf("usage: connect4-bench <mode> [args]\n"
+         "modes:\n"
+         "  kernels [iterations]   check and time popcount/winning-position kernels\n"
+         "  backends [passes]      check and time the bitboard backends of Position on random games\n"
+         "  primitives [iterations]\n"
+         "                         time the primitives of Position and the book probes\n"
+         "  perft [depth [check [moves]]]\n"
+         "                         count the move sequences to each depth from a position (default\n"
+         "                         9 from the empty board), checked against a plain array board up\n"
+         "                         to depth check (default 8)\n"
+         "  board [WxH [moves]]    solve a position on a 6x5, 7x6, 8x7 or 9x7 board\n"
+         "                         (default: empty 6x5 board)\n"
+         "  drivers [n [depth]]    compare solve drivers on n random positions (default 20 13-ply)\n"
+         "  rules [n [depth]]      check static threat rules, compare nodes on n random positions\n"
+         "                         (default 20 14-ply)\n"
+         "  engines [n [depth [slice]]]\n"
+         "                         compare recursive and iterative engines (default 20 14-ply,\n"
+         "                         10000-node slices)\n"
+         "  endgame [n [m]]        compare endgame search thresholds on n random 30-ply positions\n"
+         "                         and m 14-ply ones (default 1000 and 20)\n"
+         "  instances [t [n [depth]]]\n"
+         "                         solve n random positions with t solver instances in parallel threads\n"
+         "                         and compare with a single instance (default 4 10 14-ply)\n"
+         "  trace FILE [moves]     solve a position recording a search trace to FILE (solver\n"
+         "                         built with -DSOLVER_TRACE, see connect4-trace)\n"
+         "  reset [n]              time solver construction and n transposition table resets\n"
+         "  probes [n [depth]]     compare nodes and cache misses with and without children probes\n"
+         "                         (default 20 14-ply)\n"
+         "  tiers [n [depth [ply ...]]]\n"
+         "                         compare the single transposition table with a near-leaf tier for\n"
+         "                         positions from each ply on (default 20 14-ply, plies 22 26 30)\n"
+         "  proof [n [depth]]      compare win/draw/loss by negamax, proof-number search and their race\n"
+         "                         on n random positions (default 20 13-ply)\n"
+         "  parallel [t [n [depth]]]\n"
+         "                         compare the probes of each search run one after the other and in t\n"
+         "                         threads sharing the table (default 4 20 14-ply, -DTABLE_SHARED build)\n"
+         "  tables [n]             time n random stores and lookups in transposition tables with split\n"
+         "                         key/value arrays and with packed entries (default 10000000)\n"
+         "  answers [n [depth]]    time repeated and mirrored queries answered by the cache of answers\n"
+         "                         (default 20 14-ply)\n"
+         "  refine [n [depth ...]] compare the SOLVER_REFINE answers of n random positions of each\n"
+         "                         depth with exact answers (default 20 16, 20 and 24-ply)\n"
+         "  oracle [n [book12.dat]] solve n random 12-ply positions without the 12-move book with\n"
+         "                         each search option and check the scores against the book\n"
+         "  effort [n [min [max]]] fit the coefficients of the effort estimate on the node counts of\n"
+         "                         queries of n random positions of min to max plies (default 200\n"
+         "                         14 to 30-ply)\n");
+}
+
+
+int main(int argc, char **argv)
+{
+  if( argc < 2 ) { usage(); return 1; }
+
+  if( streq(argv[1], "kernels") )
+    return benchKernels(argc - 2, argv + 2);
+  else if( streq(argv[1], "backends") )
+    return benchBackends(argc - 2, argv + 2);
+  else if( streq(argv[1], "primitives") )
+    return benchPrimitives(argc - 2, argv + 2);
+  else if( streq(argv[1], "perft") )
+    return benchPerft(argc - 2, argv + 2);
+  else if( streq(argv[1], "board") )
+    return benchBoards(argc - 2, argv + 2);
+  else if( streq(argv[1], "drivers") )
+    return benchDrivers(argc - 2, argv + 2);
+  else if( streq(argv[1], "rules") )
+    return benchRules(argc - 2, argv + 2);
+  else if( streq(argv[1], "engines") )
+    return benchEngines(argc - 2, argv + 2);
+  else if( streq(argv[1], "endgame") )
+    return benchEndgame(argc - 2, argv + 2);
+  else if( streq(argv[1], "instances") )
+    return benchInstances(argc - 2, argv + 2);
+  else if( streq(argv[1], "trace") )
+    return benchTrace(argc - 2, argv + 2);
+  else if( streq(argv[1], "reset") )
+    return benchReset(argc - 2, argv + 2);
+  else if( streq(argv[1], "probes") )
+    return benchProbes(argc - 2, argv + 2);
+  else if( streq(argv[1], "tiers") )
+    return benchTiers(argc - 2, argv + 2);
+  else if( streq(argv[1], "proof") )
+    return benchProof(argc - 2, argv + 2);
+  else if( streq(argv[1], "parallel") )
+    return benchParallel(argc - 2, argv + 2);
+  else if( streq(argv[1], "tables") )
+    return benchTables(argc - 2, argv + 2);
+  else if( streq(argv[1], "answers") )
+    return benchAnswers(argc - 2, argv + 2);
+  else if( streq(argv[1], "refine") )
+    return benchRefine(argc - 2, argv + 2);
+  else if( streq(argv[1], "oracle") )
+    return benchOracle(argc - 2, argv + 2);
+  else if( streq(argv[1], "effort") )
+    return benchEffort(argc - 2, argv + 2);
+
+  usage();
+  return 1;
+}
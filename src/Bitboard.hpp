@@ -0,0 +1,360 @@
+/*
+ * This file is part of Connect4 Game Solver <http://connect4.gamesolver.org>
+ * Copyright (C) 2017-2019 Pascal Pons <contact@gamesolver.org>
+ *
+ * Connect4 Game Solver is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Connect4 Game Solver is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Connect4 Game Solver. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BITBOARD_HPP
+#define BITBOARD_HPP
+
+#include <cstdint>
+
+// Select the bitboard kernels used by Position at compile time.
+// Any of these can be forced with -D to compare implementations:
+//   BITBOARD_POPCOUNT_BUILTIN: compiler builtin (POPCNT instruction on x86 with -mpopcnt)
+//   BITBOARD_POPCOUNT_SPLIT32: SWAR bit count on two 32-bit halves
+//   BITBOARD_POPCOUNT_LOOP:    clear-lowest-bit loop
+//   BITBOARD_WINNING_SPLIT32:  winning positions computed on two 32-bit halves
+//   BITBOARD_SCORES_AVX2:      move scores computed 4 moves at a time in AVX2 registers
+//   BITBOARD_SCORES_SCALAR:    move scores computed one move at a time
+//   BITBOARD_BOARD_SPLIT32:    boards of at most 64 bits stored as two 32-bit words (SplitBoard),
+//                              for 32-bit targets (needs C++17, off by default)
+#if !defined(BITBOARD_POPCOUNT_BUILTIN) && !defined(BITBOARD_POPCOUNT_SPLIT32) && !defined(BITBOARD_POPCOUNT_LOOP)
+#if defined(__POPCNT__) || defined(__aarch64__) // else the builtin is a libgcc call, slower than SWAR
+#define BITBOARD_POPCOUNT_BUILTIN
+#elif defined(__x86_64__) || defined(__i386__) || defined(__arm__)
+#define BITBOARD_POPCOUNT_SPLIT32
+#else
+#define BITBOARD_POPCOUNT_LOOP
+#endif
+#endif
+
+#if !defined(BITBOARD_WINNING_SPLIT32) && defined(__arm__) && !defined(__aarch64__)
+#define BITBOARD_WINNING_SPLIT32
+#endif
+
+#if !defined(BITBOARD_SCORES_AVX2) && !defined(BITBOARD_SCORES_SCALAR)
+#if defined(__AVX2__) && !defined(BITBOARD_WINNING_SPLIT32)
+#define BITBOARD_SCORES_AVX2
+#else
+#define BITBOARD_SCORES_SCALAR
+#endif
+#endif
+
+namespace GameSolver {
+namespace Connect4 {
+namespace Bitboard {
+
+/**
+ * A bitboard of at most 64 bits held as two 32-bit words, with the operators of an unsigned
+ * integer. Every operation is written on the words: additions propagate one carry, shifts
+ * below 32 need one extra shifted OR for the carried bits, which 32-bit ARM folds into its
+ * barrel shifter. Conversion to an integer (keys of the tables) is explicit.
+ */
+struct SplitBoard {
+  uint32_t lo, hi;
+
+  constexpr SplitBoard() : lo{0}, hi{0} {}
+  constexpr SplitBoard(uint64_t v) : lo{uint32_t(v)}, hi{uint32_t(v >> 32)} {}
+  constexpr SplitBoard(uint32_t lo, uint32_t hi) : lo{lo}, hi{hi} {}
+  template<class T> constexpr explicit operator T() const { return T(uint64_t(hi) << 32 | lo); } // integers and bool
+
+  friend constexpr SplitBoard operator&(SplitBoard a, SplitBoard b) { return SplitBoard(a.lo & b.lo, a.hi & b.hi); }
+  friend constexpr SplitBoard operator|(SplitBoard a, SplitBoard b) { return SplitBoard(a.lo | b.lo, a.hi | b.hi); }
+  friend constexpr SplitBoard operator^(SplitBoard a, SplitBoard b) { return SplitBoard(a.lo ^ b.lo, a.hi ^ b.hi); }
+  constexpr SplitBoard operator~() const { return SplitBoard(~lo, ~hi); }
+
+  friend constexpr SplitBoard operator+(SplitBoard a, SplitBoard b) {
+    return SplitBoard(a.lo + b.lo, a.hi + b.hi + (uint32_t(a.lo + b.lo) < a.lo));
+  }
+  friend constexpr SplitBoard operator-(SplitBoard a, SplitBoard b) {
+    return SplitBoard(a.lo - b.lo, a.hi - b.hi - (a.lo < b.lo));
+  }
+  friend constexpr SplitBoard operator*(SplitBoard a, SplitBoard b) { // static masks only
+    return SplitBoard(uint64_t(a) * uint64_t(b));
+  }
+
+  friend constexpr SplitBoard operator<<(SplitBoard a, int s) {
+    return s == 0 ? a : s < 32 ? SplitBoard(a.lo << s, a.hi << s | a.lo >> (32 - s)) : SplitBoard(0u, a.lo << (s - 32));
+  }
+  friend constexpr SplitBoard operator>>(SplitBoard a, int s) {
+    return s == 0 ? a : s < 32 ? SplitBoard(a.lo >> s | a.hi << (32 - s), a.hi >> s) : SplitBoard(a.hi >> (s - 32), 0u);
+  }
+
+  SplitBoard &operator&=(SplitBoard b) { return *this = *this & b; }
+  SplitBoard &operator|=(SplitBoard b) { return *this = *this | b; }
+  SplitBoard &operator^=(SplitBoard b) { return *this = *this ^ b; }
+  SplitBoard &operator+=(SplitBoard b) { return *this = *this + b; }
+  SplitBoard &operator-=(SplitBoard b) { return *this = *this - b; }
+  SplitBoard &operator<<=(int s) { return *this = *this << s; }
+  SplitBoard &operator>>=(int s) { return *this = *this >> s; }
+
+  friend constexpr bool operator==(SplitBoard a, SplitBoard b) { return a.lo == b.lo && a.hi == b.hi; }
+  friend constexpr bool operator!=(SplitBoard a, SplitBoard b) { return !(a == b); }
+  friend constexpr bool operator<(SplitBoard a, SplitBoard b) { return a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo); }
+  friend constexpr bool operator>(SplitBoard a, SplitBoard b) { return b < a; }
+  friend constexpr bool operator<=(SplitBoard a, SplitBoard b) { return !(b < a); }
+  friend constexpr bool operator>=(SplitBoard a, SplitBoard b) { return !(a < b); }
+};
+
+/**
+ * Smallest unsigned type holding a bitboard of the given number of bits:
+ * uint64_t (or SplitBoard with BITBOARD_BOARD_SPLIT32), or unsigned __int128
+ * (g++/clang on 64-bit targets only) above 64 bits.
+ */
+#if defined(BITBOARD_BOARD_SPLIT32)
+template<int bits, bool fits64 = (bits <= 64)> struct BoardType { using type = SplitBoard; };
+#else
+template<int bits, bool fits64 = (bits <= 64)> struct BoardType { using type = uint64_t; };
+#endif
+#if defined(__SIZEOF_INT128__)
+template<int bits> struct BoardType<bits, false> { using type = unsigned __int128; };
+#endif
+template<int bits> using board_t = typename BoardType<bits>::type;
+
+/**
+ * counts number of bit set to one in a 64bits integer
+ * by clearing the lowest set bit until none is left.
+ */
+inline unsigned int popcount_loop(uint64_t m) {
+  unsigned int c;
+  for(c = 0; m; c++) m &= m - 1;
+  return c;
+}
+
+/**
+ * counts number of bit set to one in a 32bits integer
+ * using parallel additions (no loop, no table, one multiply).
+ */
+inline unsigned int popcount32(uint32_t m) {
+  m = m - ((m >> 1) & 0x55555555);
+  m = (m & 0x33333333) + ((m >> 2) & 0x33333333);
+  m = (m + (m >> 4)) & 0x0F0F0F0F;
+  return (m * 0x01010101) >> 24;
+}
+
+/**
+ * counts number of bit set to one in a 64bits integer,
+ * using only 32-bit operations (for 32-bit targets without popcount instruction)
+ */
+inline unsigned int popcount_split32(uint64_t m) {
+  return popcount32(uint32_t(m)) + popcount32(uint32_t(m >> 32));
+}
+
+/**
+ * counts number of bit set to one in a 64bits integer
+ * using the compiler builtin (POPCNT instruction when available).
+ */
+inline unsigned int popcount_builtin(uint64_t m) {
+  return __builtin_popcountll(m);
+}
+
+inline unsigned int popcount(uint64_t m) {
+#if defined(BITBOARD_POPCOUNT_BUILTIN)
+  return popcount_builtin(m);
+#elif defined(BITBOARD_POPCOUNT_SPLIT32)
+  return popcount_split32(m);
+#else
+  return popcount_loop(m);
+#endif
+}
+
+inline unsigned int popcount(SplitBoard m) {
+#if defined(BITBOARD_POPCOUNT_BUILTIN)
+  return __builtin_popcount(m.lo) + __builtin_popcount(m.hi);
+#else
+  return popcount32(m.lo) + popcount32(m.hi);
+#endif
+}
+
+#if defined(__SIZEOF_INT128__)
+inline unsigned int popcount(unsigned __int128 m) {
+  return popcount(uint64_t(m)) + popcount(uint64_t(m >> 64));
+}
+#endif
+
+/**
+ * @param position, a bitmap of the player to evaluate the winning pos
+ * @param mask, a mask of the already played spots
+ * @param board_mask, a mask of all the cells of the board
+ *
+ * @return a bitmap of all the winning free spots making an alignment
+ */
+template<int HEIGHT, class position_t>
+inline position_t winning_position_generic(position_t position, position_t mask, position_t board_mask) {
+  // vertical;
+  position_t r = (position << 1) & (position << 2) & (position << 3);
+
+  //horizontal
+  position_t p = (position << (HEIGHT + 1)) & (position << 2 * (HEIGHT + 1));
+  r |= p & (position << 3 * (HEIGHT + 1));
+  r |= p & (position >> (HEIGHT + 1));
+  p = (position >> (HEIGHT + 1)) & (position >> 2 * (HEIGHT + 1));
+  r |= p & (position << (HEIGHT + 1));
+  r |= p & (position >> 3 * (HEIGHT + 1));
+
+  //diagonal 1
+  p = (position << HEIGHT) & (position << 2 * HEIGHT);
+  r |= p & (position << 3 * HEIGHT);
+  r |= p & (position >> HEIGHT);
+  p = (position >> HEIGHT) & (position >> 2 * HEIGHT);
+  r |= p & (position << HEIGHT);
+  r |= p & (position >> 3 * HEIGHT);
+
+  //diagonal 2
+  p = (position << (HEIGHT + 2)) & (position << 2 * (HEIGHT + 2));
+  r |= p & (position << 3 * (HEIGHT + 2));
+  r |= p & (position >> (HEIGHT + 2));
+  p = (position >> (HEIGHT + 2)) & (position >> 2 * (HEIGHT + 2));
+  r |= p & (position << (HEIGHT + 2));
+  r |= p & (position >> 3 * (HEIGHT + 2));
+
+  return r & (board_mask ^ mask);
+}
+
+/**
+ * A 64-bit bitmap held as two 32-bit halves.
+ * Shifts by a constant below 32 only need one extra shifted OR for the carried bits,
+ * which 32-bit ARM folds into its barrel shifter instead of a multi-instruction 64-bit sequence.
+ */
+struct Split32 {
+  uint32_t lo, hi;
+
+  Split32(uint32_t lo, uint32_t hi) : lo{lo}, hi{hi} {}
+  explicit Split32(uint64_t v) : lo{uint32_t(v)}, hi{uint32_t(v >> 32)} {}
+  explicit Split32(SplitBoard v) : lo{v.lo}, hi{v.hi} {}
+  uint64_t value() const { return uint64_t(hi) << 32 | lo; }
+
+  template<int s> Split32 shl() const { return Split32(lo << s, hi << s | lo >> (32 - s)); }
+  template<int s> Split32 shr() const { return Split32(lo >> s | hi << (32 - s), hi >> s); }
+
+  Split32 operator&(const Split32 &o) const { return Split32(lo & o.lo, hi & o.hi); }
+  Split32 &operator|=(const Split32 &o) { lo |= o.lo; hi |= o.hi; return *this; }
+};
+
+/**
+ * Same as winning_position_generic, computed on 32-bit halves.
+ */
+template<int HEIGHT, class board>
+inline Split32 winning_split32(board position64) {
+  static_assert(3 * (HEIGHT + 2) < 32, "shifts must stay below 32 bits");
+  constexpr int H = HEIGHT, H1 = HEIGHT + 1, H2 = HEIGHT + 2;
+  const Split32 position(position64);
+
+  // vertical;
+  Split32 r = position.shl<1>() & position.shl<2>() & position.shl<3>();
+
+  //horizontal
+  Split32 p = position.shl<H1>() & position.shl<2 * H1>();
+  r |= p & position.shl<3 * H1>();
+  r |= p & position.shr<H1>();
+  p = position.shr<H1>() & position.shr<2 * H1>();
+  r |= p & position.shl<H1>();
+  r |= p & position.shr<3 * H1>();
+
+  //diagonal 1
+  p = position.shl<H>() & position.shl<2 * H>();
+  r |= p & position.shl<3 * H>();
+  r |= p & position.shr<H>();
+  p = position.shr<H>() & position.shr<2 * H>();
+  r |= p & position.shl<H>();
+  r |= p & position.shr<3 * H>();
+
+  //diagonal 2
+  p = position.shl<H2>() & position.shl<2 * H2>();
+  r |= p & position.shl<3 * H2>();
+  r |= p & position.shr<H2>();
+  p = position.shr<H2>() & position.shr<2 * H2>();
+  r |= p & position.shl<H2>();
+  r |= p & position.shr<3 * H2>();
+
+  return r;
+}
+
+template<int HEIGHT>
+inline uint64_t winning_position_split32(uint64_t position, uint64_t mask, uint64_t board_mask) {
+  return winning_split32<HEIGHT>(position).value() & (board_mask ^ mask);
+}
+
+template<int HEIGHT, class position_t>
+inline position_t winning_position(position_t position, position_t mask, position_t board_mask) {
+  return winning_position_generic<HEIGHT>(position, mask, board_mask);
+}
+
+#if defined(BITBOARD_WINNING_SPLIT32)
+template<int HEIGHT>
+inline uint64_t winning_position(uint64_t position, uint64_t mask, uint64_t board_mask) {
+  return winning_position_split32<HEIGHT>(position, mask, board_mask);
+}
+#endif
+
+template<int HEIGHT>
+inline SplitBoard winning_position(SplitBoard position, SplitBoard mask, SplitBoard board_mask) {
+  const Split32 r = winning_split32<HEIGHT>(position);
+  return SplitBoard(r.lo, r.hi) & (board_mask ^ mask);
+}
+
+/**
+ * Score of n candidate moves of the same position: for each move (a single bit),
+ * the number of winning free spots of position | move, i.e.
+ * popcount(winning_position(position | moves[i], mask, board_mask)).
+ * One move at a time, sharing only the free cells mask.
+ */
+template<int HEIGHT, class position_t>
+inline void move_scores_scalar(position_t position, position_t mask, position_t board_mask,
+                               const position_t *moves, int n, int *scores) {
+  for(int i = 0; i < n; i++)
+    scores[i] = popcount(winning_position<HEIGHT>(position | moves[i], mask, board_mask));
+}
+
+#if defined(__GNUC__) && defined(__AVX2__)
+typedef uint64_t u64x4 __attribute__((vector_size(32))); // 4 bitboards, one per AVX2 lane
+
+/**
+ * Same as move_scores_scalar, 4 moves at a time: the winning positions kernel
+ * runs once on 4 lanes holding position | move, position and masks are broadcast once.
+ */
+template<int HEIGHT>
+inline void move_scores_avx2(uint64_t position, uint64_t mask, uint64_t board_mask,
+                             const uint64_t *moves, int n, int *scores) {
+  const u64x4 zero = {0, 0, 0, 0};
+  const u64x4 p = zero | position, m = zero | mask, b = zero | board_mask;
+  for(int i = 0; i < n; i += 4) {
+    u64x4 lanes = p;
+    for(int j = 0; j < 4 && i + j < n; j++) lanes[j] |= moves[i + j];
+    const u64x4 w = winning_position_generic<HEIGHT>(lanes, m, b);
+    for(int j = 0; j < 4 && i + j < n; j++) scores[i + j] = popcount(uint64_t(w[j]));
+  }
+}
+#endif
+
+template<int HEIGHT, class position_t>
+inline void move_scores(position_t position, position_t mask, position_t board_mask,
+                        const position_t *moves, int n, int *scores) {
+  move_scores_scalar<HEIGHT>(position, mask, board_mask, moves, n, scores);
+}
+
+#if defined(BITBOARD_SCORES_AVX2)
+template<int HEIGHT>
+inline void move_scores(uint64_t position, uint64_t mask, uint64_t board_mask,
+                        const uint64_t *moves, int n, int *scores) {
+  move_scores_avx2<HEIGHT>(position, mask, board_mask, moves, n, scores);
+}
+#endif
+
+} // namespace Bitboard
+} // namespace Connect4
+} // namespace GameSolver
+#endif
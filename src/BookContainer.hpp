@@ -0,0 +1,250 @@
+/*
+ * This file is part of Connect4 Game Solver <http://connect4.gamesolver.org>
+ * Copyright (C) 2017-2019 Pascal Pons <contact@gamesolver.org>
+ *
+ * Connect4 Game Solver is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Connect4 Game Solver is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Connect4 Game Solver. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BOOK_CONTAINER_HPP
+#define BOOK_CONTAINER_HPP
+
+#ifdef _X86
+#include <stdio.h>
+#endif
+
+#include "Position.hpp"
+#include "OpeningBook.hpp"
+
+namespace GameSolver {
+namespace Connect4 {
+
+/**
+ * Opening book container holding several depth layers in one versioned, checksummed file
+ * (see connect4-book for the converter from book.dat and book12.dat).
+ *
+ * File format (integers are little endian):
+ * - 16 bytes header:
+ *   - 4 bytes: magic "C4BK"
+ *   - 1 byte: format version (BOOK_CONTAINER_VERSION)
+ *   - 1 byte: board width
+ *   - 1 byte: board height
+ *   - 1 byte: number of layers (at most BOOK_CONTAINER_MAX_LAYERS)
+ *   - 4 bytes: total length of the file
+ *   - 4 bytes: FNV-1a checksum of all the bytes after the header
+ * - 16 bytes per layer:
+ *   - 1 byte: format (BOOK_LAYER_HASH or BOOK_LAYER_SORTED)
+ *   - 1 byte: min position depth
+ *   - 1 byte: max position depth
+ *   - 1 byte: flags (BOOK_LAYER_COMPLETE: positions missing in the layer are draws
+ *             or immediate wins)
+ *   - 4 bytes: offset of the layer data from the start of the file (multiple of 8)
+ *   - 4 bytes: length of the layer data
+ *   - 4 bytes: number of blocks (BOOK_LAYER_SORTED), 0 otherwise
+ * - layer data, for BOOK_LAYER_HASH: an opening book file (see OpeningBook::loadData),
+ *   for BOOK_LAYER_SORTED:
+ *   - 16 bytes per block: 8 bytes first key3 of the block, 4 bytes offset of the block
+ *     from the end of this index, 4 bytes reserved
+ *   - blocks of entries sorted by key3, each entry a LEB128 varint of (delta << 6 | value)
+ *     where delta is the difference with the key3 of the previous entry of the block
+ *     (0 for the first one) and value is score - MIN_SCORE + 1
+ *
+ * Sorted layers are used in place (rodata or mapped file), hash layers are copied
+ * into a transposition table as by OpeningBook.
+ */
+#define BOOK_CONTAINER_VERSION    1
+#define BOOK_CONTAINER_MAX_LAYERS 8
+#define BOOK_LAYER_HASH           1
+#define BOOK_LAYER_SORTED         2
+#define BOOK_LAYER_COMPLETE       1
+
+class BookContainer {
+  struct Layer {
+    int format, minDepth, maxDepth, flags;
+    const unsigned char *data;
+    size_t length, blocks;
+    OpeningBook *hash;
+  };
+
+  const int width;
+  const int height;
+  int nbLayers;
+  int depth; // max depth of all layers, -1 if empty
+  Layer layers[BOOK_CONTAINER_MAX_LAYERS];
+
+  static uint32_t le32(const unsigned char *p) {
+    return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+  }
+
+  static uint64_t le64(const unsigned char *p) {
+    return uint64_t(le32(p)) | uint64_t(le32(p + 4)) << 32;
+  }
+
+  void clear() {
+    for(int i = 0; i < nbLayers; i++) delete layers[i].hash;
+    nbLayers = 0;
+    depth = -1;
+  }
+
+  // true if the index of a sorted layer fits its data: blocks in order within the entries,
+  // getSorted reads nothing outside the layer
+  static bool validSorted(const Layer &l) {
+    if(l.blocks > l.length / 16) return false;
+    const size_t entries = l.length - 16 * l.blocks;
+    size_t previous = 0;
+    for(size_t i = 0; i < l.blocks; i++) {
+      const size_t offset = le32(l.data + 16 * i + 8);
+      if(offset < previous || offset > entries) return false;
+      previous = offset;
+    }
+    return true;
+  }
+
+  // value of key in a sorted layer, 0 if missing
+  static int getSorted(const Layer &l, uint64_t key) {
+    const unsigned char *index = l.data, *entries = l.data + 16 * l.blocks;
+    if(l.blocks == 0 || le64(index) > key) return 0;
+
+    size_t lo = 0, hi = l.blocks; // last block starting at or below key
+    while(hi - lo > 1) {
+      size_t med = (lo + hi) / 2;
+      if(le64(index + 16 * med) <= key) lo = med;
+      else hi = med;
+    }
+
+    const unsigned char *p = entries + le32(index + 16 * lo + 8);
+    const unsigned char *end = lo + 1 < l.blocks ? entries + le32(index + 16 * (lo + 1) + 8) : l.data + l.length;
+    uint64_t k = le64(index + 16 * lo);
+    while(p < end) {
+      uint64_t v = 0;
+      for(int shift = 0; p < end; shift += 7) {
+        if(shift >= 64) return 0; // corrupt varint, longer than any 64-bit value
+        v |= uint64_t(*p & 0x7f) << shift;
+        if(!(*p++ & 0x80)) break;
+      }
+      k += v >> 6;
+      if(k == key) return int(v & 63);
+      if(k > key) break;
+    }
+    return 0;
+  }
+
+ public:
+  BookContainer(int width, int height) : width{width}, height{height}, nbLayers{0}, depth{-1} {} // Empty container
+
+  ~BookContainer() {
+    clear();
+  }
+
+  /**
+   * FNV-1a hash, the checksum of the container.
+   */
+  static uint32_t checksum(const unsigned char *data, size_t len) {
+    uint32_t h = 2166136261u;
+    while(len--) h = (h ^ *data++) * 16777619u;
+    return h;
+  }
+
+#ifdef _X86
+  void loadFile(const char *filename)
+  {
+    FILE *f = fopen(filename, "rb");
+    if( f )
+      {
+        fseek(f, 0, SEEK_END);
+        size_t len = ftell(f);
+        unsigned char *buf = new unsigned char[len];
+        if( buf )
+          {
+            fseek(f, 0, SEEK_SET);
+            if( fread(buf, 1, len, f)!=len || !setData(buf, len) ) delete[] buf; // kept while in use by sorted layers
+          }
+
+        fclose(f);
+      }
+  }
+#endif
+
+  /**
+   * Use a container (see file format above), data must stay valid while the container is used.
+   * @return false, leaving the container empty, if data is not a valid container for the board size.
+   */
+  bool setData(const unsigned char *data, size_t len)
+  {
+    clear();
+    if( len<16 || data[0]!='C' || data[1]!='4' || data[2]!='B' || data[3]!='K' ) return false;
+    if( data[4]!=BOOK_CONTAINER_VERSION || data[5]!=width || data[6]!=height ) return false;
+    if( data[7]>BOOK_CONTAINER_MAX_LAYERS || le32(data + 8)!=len ) return false;
+    if( len<16 + 16 * size_t(data[7]) || checksum(data + 16, len - 16)!=le32(data + 12) ) return false;
+
+    for(int i = 0; i < data[7]; i++)
+      {
+        const unsigned char *d = data + 16 + 16 * i;
+        Layer &l = layers[nbLayers];
+        l.format = d[0];
+        l.minDepth = d[1];
+        l.maxDepth = d[2];
+        l.flags = d[3];
+        size_t offset = le32(d + 4);
+        l.length = le32(d + 8);
+        l.blocks = le32(d + 12);
+        l.hash = NULL;
+        if( offset>len || l.length>len - offset || l.minDepth>l.maxDepth ) { clear(); return false; }
+        l.data = data + offset;
+
+        if( l.format==BOOK_LAYER_HASH )
+          {
+            l.hash = new OpeningBook(width, height);
+            l.hash->loadData(l.data, l.length);
+            if( !l.hash->ok() ) { delete l.hash; clear(); return false; }
+          }
+        else if( l.format!=BOOK_LAYER_SORTED || !validSorted(l) ) { clear(); return false; }
+
+        nbLayers++;
+        if( l.maxDepth>depth ) depth = l.maxDepth;
+      }
+
+    return nbLayers>0;
+  }
+
+  bool ok() const { return nbLayers>0; }
+
+  int maxDepth() const { return depth; }
+
+  /**
+   * @return score - P::MIN_SCORE + 1 for a position of one of the layers, 0 if unknown.
+   */
+  template<class P>
+  int get(const P &pos) const
+  {
+    const int n = pos.nbMoves();
+    if( n>depth ) return 0;
+
+    for(int i = 0; i < nbLayers; i++)
+      {
+        const Layer &l = layers[i];
+        if( n<l.minDepth || n>l.maxDepth ) continue;
+
+        int val = l.hash ? l.hash->get(pos) : getSorted(l, pos.key3());
+        if( val==0 && (l.flags & BOOK_LAYER_COMPLETE) )
+          val = (pos.canWinNext() ? (P::WIDTH * P::HEIGHT + 1 - n) / 2 : 0) - P::MIN_SCORE + 1;
+        if( val ) return val;
+      }
+
+    return 0;
+  }
+};
+
+} // namespace Connect4
+} // namespace GameSolver
+#endif
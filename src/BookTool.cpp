@@ -0,0 +1,433 @@
+// -----------------------------------------------------------------------------
+// Connect 4 solver on bare metal Raspberry Pi Zero
+// Copyright (C) 2019 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+// Converter from the book.dat and book12.dat opening books to the book container
+// format (see BookContainer.hpp), x86 only.
+// usage: connect4-book build|info|check ...
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Position.hpp"
+#include "OpeningBook.hpp"
+#include "OpeningBook12.hpp"
+#include "BookContainer.hpp"
+
+using namespace GameSolver::Connect4;
+
+#define BLOCK_ENTRIES 32 // entries per block of a sorted layer
+
+
+static unsigned char *readFile(const char *filename, size_t *len)
+{
+  unsigned char *buf = NULL;
+  FILE *f = fopen(filename, "rb");
+  if( f )
+    {
+      fseek(f, 0, SEEK_END);
+      *len = ftell(f);
+      buf = new unsigned char[*len];
+      fseek(f, 0, SEEK_SET);
+      if( fread(buf, 1, *len, f)!=*len ) { delete[] buf; buf = NULL; }
+      fclose(f);
+    }
+
+  if( buf==NULL ) printf("can not read %s\n", filename);
+  return buf;
+}
+
+
+static bool streq(const char *a, const char *b)
+{
+  while( *a && *a==*b ) { a++; b++; }
+  return *a==*b;
+}
+
+
+// ----------------------------------------------------------------------------
+// growable byte buffer, little endian output
+
+struct Buffer
+{
+  unsigned char *data;
+  size_t len, size;
+
+  Buffer() : data{NULL}, len{0}, size{0} {}
+  ~Buffer() { delete[] data; }
+
+  void put8(unsigned int v)
+  {
+    if( len==size )
+      {
+        size = size ? 2*size : 4096;
+        unsigned char *d = new unsigned char[size];
+        for(size_t i=0; i<len; i++) d[i] = data[i];
+        delete[] data;
+        data = d;
+      }
+    data[len++] = v;
+  }
+
+  void put32(uint32_t v) { for(int i=0; i<4; i++) put8((v >> 8*i) & 0xff); }
+  void put64(uint64_t v) { put32(uint32_t(v)); put32(uint32_t(v >> 32)); }
+  void putBytes(const unsigned char *p, size_t n) { while( n-- ) put8(*p++); }
+  void align8() { while( len & 7 ) put8(0); }
+
+  void varint(uint64_t v)
+  {
+    while( v>=0x80 ) { put8((v & 0x7f) | 0x80); v >>= 7; }
+    put8(v);
+  }
+
+  void set32(size_t pos, uint32_t v) { for(int i=0; i<4; i++) data[pos+i] = (v >> 8*i) & 0xff; }
+};
+
+
+// ----------------------------------------------------------------------------
+// sorted layers
+
+struct Entry { uint64_t key; int value; };
+
+static int compareEntries(const void *a, const void *b)
+{
+  uint64_t ka = ((const Entry *) a)->key, kb = ((const Entry *) b)->key;
+  return ka<kb ? -1 : ka>kb ? 1 : 0;
+}
+
+
+// sort entries, drop duplicate keys and encode them as a sorted layer
+static void encodeSorted(Entry *entries, size_t n, Buffer &out, uint32_t *blocks)
+{
+  qsort(entries, n, sizeof(Entry), compareEntries);
+
+  Buffer index, data;
+  size_t inBlock = 0;
+  uint64_t last = 0;
+  *blocks = 0;
+  for(size_t i=0; i<n; i++)
+    {
+      if( i>0 && entries[i].key==last ) continue;
+
+      uint64_t delta = entries[i].key - last;
+      if( inBlock==0 || inBlock==BLOCK_ENTRIES || (delta >> 57)!=0 )
+        {
+          index.put64(entries[i].key);
+          index.put32(data.len);
+          index.put32(0);
+          ++*blocks;
+          inBlock = 0;
+          delta = 0;
+        }
+
+      data.varint(delta << 6 | entries[i].value);
+      last = entries[i].key;
+      inBlock++;
+    }
+
+  out.putBytes(index.data, index.len);
+  out.putBytes(data.data, data.len);
+}
+
+
+// all positions of book.dat (up to its depth) by enumerating the games
+static void enumerate(const OpeningBook &book, const Position &P, int depth, Entry *entries, size_t &n, size_t max)
+{
+  if( int val = book.get(P) )
+    {
+      if( n<max ) { entries[n].key = P.key3(); entries[n].value = val; }
+      n++;
+    }
+
+  if( P.nbMoves()<depth )
+    for(int col=0; col<Position::WIDTH; col++)
+      if( P.canPlay(col) && !P.isWinningMove(col) )
+        {
+          Position P2(P);
+          P2.playCol(col);
+          enumerate(book, P2, depth, entries, n, max);
+        }
+}
+
+static Entry *sortedFromBook(const unsigned char *data, size_t len, int *depth, size_t *n)
+{
+  OpeningBook book(Position::WIDTH, Position::HEIGHT);
+  book.loadData(data, len);
+  if( !book.ok() ) { printf("invalid book.dat\n"); return NULL; }
+  *depth = data[2];
+
+  // the same position is reached by several games, first count them all
+  size_t count = 0;
+  enumerate(book, Position(), *depth, NULL, count, 0);
+  Entry *entries = new Entry[count];
+  *n = 0;
+  enumerate(book, Position(), *depth, entries, *n, count);
+  return entries;
+}
+
+
+// position of a book12 Huffman code (see Position::getHuffman), false if invalid
+static bool decodeHuffman(uint32_t code, Position &P)
+{
+  int board[Position::WIDTH][Position::HEIGHT] = {{0}};
+  int bit = 31;
+  for(int c=0; c<Position::WIDTH; c++)
+    {
+      int r = 0;
+      while( bit>=0 && (code >> bit) & 1 )
+        {
+          if( r==Position::HEIGHT || bit==0 ) return false;
+          board[c][r++] = ((code >> (bit-1)) & 1) ? 2 : 1;
+          bit -= 2;
+        }
+      bit--; // end of column
+    }
+
+  return P.setBoard(board);
+}
+
+static Entry *sortedFromBook12(const unsigned char *data, size_t len, size_t *n)
+{
+  if( len<BOOKSIZE*5 ) { printf("invalid book12.dat\n"); return NULL; }
+
+  Entry *entries = new Entry[BOOKSIZE];
+  *n = 0;
+  for(size_t i=0; i<BOOKSIZE; i++)
+    {
+      uint32_t code = (uint32_t(data[4*i]) | uint32_t(data[4*i+1]) << 8 | uint32_t(data[4*i+2]) << 16 | uint32_t(data[4*i+3]) << 24) & 0xFFFFFFFC;
+      Position P;
+      int h = 0, hm;
+      if( decodeHuffman(code, P) ) P.getHuffman(h, hm);
+      if( P.nbMoves()!=12 || uint32_t(h)!=code )
+        {
+          printf("invalid book12.dat entry %u: %08x\n", (unsigned int) i, code);
+          delete[] entries;
+          return NULL;
+        }
+
+      entries[*n].key = P.key3();
+      entries[*n].value = OpeningBook12::distanceToValue(P, (signed char) data[4*BOOKSIZE + i]);
+      (*n)++;
+    }
+
+  return entries;
+}
+
+
+// ----------------------------------------------------------------------------
+// commands
+
+static int build(int argc, char **argv)
+{
+  if( argc<3 || (argc & 1)==0 ) return -1;
+
+  Buffer layers[BOOK_CONTAINER_MAX_LAYERS];
+  int formats[BOOK_CONTAINER_MAX_LAYERS], minDepth[BOOK_CONTAINER_MAX_LAYERS], maxDepth[BOOK_CONTAINER_MAX_LAYERS], flags[BOOK_CONTAINER_MAX_LAYERS];
+  uint32_t blocks[BOOK_CONTAINER_MAX_LAYERS];
+  int nbLayers = 0;
+
+  for(int i=1; i<argc; i+=2)
+    {
+      size_t len;
+      unsigned char *data = readFile(argv[i+1], &len);
+      if( data==NULL || nbLayers==BOOK_CONTAINER_MAX_LAYERS ) return 1;
+
+      Entry *entries = NULL;
+      size_t n = 0;
+      blocks[nbLayers] = 0;
+      flags[nbLayers] = 0;
+      if( streq(argv[i], "hash") )
+        {
+          // book.dat as it is
+          OpeningBook book(Position::WIDTH, Position::HEIGHT);
+          book.loadData(data, len);
+          if( !book.ok() ) { printf("invalid book.dat\n"); return 1; }
+          formats[nbLayers] = BOOK_LAYER_HASH;
+          minDepth[nbLayers] = 0;
+          maxDepth[nbLayers] = data[2];
+          layers[nbLayers].putBytes(data, len);
+        }
+      else if( streq(argv[i], "sorted") )
+        {
+          int depth;
+          if( (entries = sortedFromBook(data, len, &depth, &n))==NULL ) return 1;
+          formats[nbLayers] = BOOK_LAYER_SORTED;
+          minDepth[nbLayers] = 0;
+          maxDepth[nbLayers] = depth;
+        }
+      else if( streq(argv[i], "book12") )
+        {
+          if( (entries = sortedFromBook12(data, len, &n))==NULL ) return 1;
+          formats[nbLayers] = BOOK_LAYER_SORTED;
+          minDepth[nbLayers] = maxDepth[nbLayers] = 12;
+          flags[nbLayers] = BOOK_LAYER_COMPLETE;
+        }
+      else
+        return -1;
+
+      if( entries )
+        {
+          encodeSorted(entries, n, layers[nbLayers], &blocks[nbLayers]);
+          delete[] entries;
+        }
+
+      printf("layer %i: %s, depth %i-%i, %u bytes\n", nbLayers, argv[i], minDepth[nbLayers], maxDepth[nbLayers], (unsigned int) layers[nbLayers].len);
+      delete[] data;
+      nbLayers++;
+    }
+
+  Buffer out;
+  out.put8('C'); out.put8('4'); out.put8('B'); out.put8('K');
+  out.put8(BOOK_CONTAINER_VERSION);
+  out.put8(Position::WIDTH);
+  out.put8(Position::HEIGHT);
+  out.put8(nbLayers);
+  out.put32(0); // length
+  out.put32(0); // checksum
+
+  size_t offset = 16 + 16 * nbLayers;
+  for(int i=0; i<nbLayers; i++)
+    {
+      offset = (offset + 7) & ~size_t(7);
+      out.put8(formats[i]);
+      out.put8(minDepth[i]);
+      out.put8(maxDepth[i]);
+      out.put8(flags[i]);
+      out.put32(offset);
+      out.put32(layers[i].len);
+      out.put32(blocks[i]);
+      offset += layers[i].len;
+    }
+
+  for(int i=0; i<nbLayers; i++)
+    {
+      out.align8();
+      out.putBytes(layers[i].data, layers[i].len);
+    }
+
+  out.set32(8, out.len);
+  out.set32(12, BookContainer::checksum(out.data + 16, out.len - 16));
+
+  FILE *f = fopen(argv[0], "wb");
+  if( f==NULL || fwrite(out.data, 1, out.len, f)!=out.len ) { printf("can not write %s\n", argv[0]); return 1; }
+  fclose(f);
+  printf("%s: %i layers, %u bytes\n", argv[0], nbLayers, (unsigned int) out.len);
+  return 0;
+}
+
+
+static int info(int argc, char **argv)
+{
+  if( argc<1 ) return -1;
+
+  size_t len;
+  unsigned char *data = readFile(argv[0], &len);
+  if( data==NULL ) return 1;
+
+  BookContainer books(Position::WIDTH, Position::HEIGHT);
+  if( !books.setData(data, len) )
+    {
+      printf("%s: not a valid %ix%i book container (bad header, size, checksum or layer index)\n", argv[0], Position::WIDTH, Position::HEIGHT);
+      return 1;
+    }
+
+  printf("%s: version %i, %ix%i, %i layers, %u bytes, checksum ok\n", argv[0], data[4], data[5], data[6], data[7], (unsigned int) len);
+  for(int i=0; i<data[7]; i++)
+    {
+      const unsigned char *d = data + 16 + 16*i;
+      printf("  layer %i: %s%s, depth %i-%i, %u bytes", i, d[0]==BOOK_LAYER_HASH ? "hash" : "sorted",
+             (d[3] & BOOK_LAYER_COMPLETE) ? " (complete)" : "", d[1], d[2], uint32_t(d[8]) | d[9] << 8 | d[10] << 16 | uint32_t(d[11]) << 24);
+      if( d[0]==BOOK_LAYER_SORTED ) printf(", %u blocks", uint32_t(d[12]) | d[13] << 8 | d[14] << 16 | uint32_t(d[15]) << 24);
+      printf("\n");
+    }
+  return 0;
+}
+
+
+// compare the container with the original books on random games
+static int check(int argc, char **argv)
+{
+  if( argc<2 ) return -1;
+  const int count = argc>3 ? atoi(argv[3]) : 100000;
+
+  size_t len, len1, len12 = 0;
+  unsigned char *data = readFile(argv[0], &len), *data1 = readFile(argv[1], &len1), *data12 = argc>2 ? readFile(argv[2], &len12) : NULL;
+  if( data==NULL || data1==NULL ) return 1;
+
+  BookContainer books(Position::WIDTH, Position::HEIGHT);
+  OpeningBook book(Position::WIDTH, Position::HEIGHT);
+  OpeningBook12 book12(Position::WIDTH, Position::HEIGHT);
+  if( !books.setData(data, len) ) { printf("invalid container %s\n", argv[0]); return 1; }
+  book.loadData(data1, len1);
+  if( data12 ) book12.setData(data12, len12);
+
+  int found = 0, errors = 0;
+  srand(1);
+  for(int i=0; i<count; i++)
+    {
+      Position P;
+      int n = rand() % (book12.ok() ? 13 : books.maxDepth() + 1);
+      for(int m=0; m<n; m++)
+        {
+          int col, tries = 0;
+          do { col = rand() % Position::WIDTH; } while( (!P.canPlay(col) || P.isWinningMove(col)) && ++tries<100 );
+          if( tries==100 ) break;
+          P.playCol(col);
+        }
+
+      int expected = P.nbMoves()==12 ? book12.get(P) : book.get(P);
+      int val = books.get(P);
+      if( val ) found++;
+      if( val!=expected ) errors++;
+    }
+
+  printf("%i random positions, %i found in the container, %i differences with the original books\n", count, found, errors);
+  return errors ? 1 : 0;
+}
+
+
+static void usage()
+{
+  printf("usage: connect4-book <command> [args]\n"
+         "commands:\n"
+         "  build OUT.c4b [LAYER FILE]...   build a book container, LAYER is one of:\n"
+         "                                  hash:   book.dat as it is\n"
+         "                                  sorted: book.dat positions as a compressed sorted layer\n"
+         "                                  book12: book12.dat as a compressed sorted layer\n"
+         "  info FILE.c4b                   check a book container and list its layers\n"
+         "  check FILE.c4b book.dat [book12.dat [n]]\n"
+         "                                  compare a container with the original books on n random games\n");
+}
+
+
+int main(int argc, char **argv)
+{
+  int r = -1;
+  if( argc>=2 )
+    {
+      if( streq(argv[1], "build") )
+        r = build(argc - 2, argv + 2);
+      else if( streq(argv[1], "info") )
+        r = info(argc - 2, argv + 2);
+      else if( streq(argv[1], "check") )
+        r = check(argc - 2, argv + 2);
+    }
+
+  if( r<0 ) { usage(); return 1; }
+  return r;
+}
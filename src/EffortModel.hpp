@@ -0,0 +1,90 @@
+/*
+ * This file is part of Connect4 Game Solver <http://connect4.gamesolver.org>
+ * Copyright (C) 2017-2019 Pascal Pons <contact@gamesolver.org>
+ *
+ * Connect4 Game Solver is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Connect4 Game Solver is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Connect4 Game Solver. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EFFORT_MODEL_HPP
+#define EFFORT_MODEL_HPP
+
+#include "Position.hpp"
+
+namespace GameSolver {
+namespace Connect4 {
+
+/**
+ * Estimate of the number of nodes a query will search, computed from cheap features of its
+ * position before any search. log2 of the node count is modelled as a linear function of
+ * the features, with coefficients fitted by least squares on benchmark node counts
+ * (connect4-bench effort prints new ones).
+ *
+ * Features of a position with the player to move:
+ * - 1 (constant term)
+ * - number of empty cells
+ * - number of non losing moves
+ * - number of empty cells where the player to move would align four
+ * - same for the opponent
+ *
+ * Opening books are only looked up for positions up to their depth, so they do not shorten
+ * the search of deeper positions: when the children of the position are in the books the
+ * estimate is 0, otherwise the books are not a feature.
+ */
+template<class P>
+class EffortModel {
+  using position_t = typename P::position_t;
+
+ public:
+  static constexpr int FEATURES = 5;
+  static constexpr int SCALE = 256; // coefficients are in 1/SCALE of log2(nodes)
+
+  // features of P, in f
+  static void features(const P &pos, int *f) {
+    f[0] = 1;
+    f[1] = P::WIDTH * P::HEIGHT - pos.nbMoves();
+    f[2] = pos.popcount(pos.possibleNonLosingMoves());
+    f[3] = pos.popcount(pos.winning_position() & ~pos.mask);
+    f[4] = pos.popcount(pos.opponent_winning_position() & ~pos.mask);
+  }
+
+  /**
+   * @return the estimated log2 of the node count for features f and the given coefficients
+   *         (0 to 63).
+   */
+  static int estimate(const int *f, const int *coefficients) {
+    int e = 0;
+    for(int i = 0; i < FEATURES; i++) e += coefficients[i] * f[i];
+    e = (e + SCALE / 2) / SCALE;
+    return e < 0 ? 0 : e > 63 ? 63 : e;
+  }
+
+  /**
+   * @return the estimated log2 of the number of nodes searched to answer a query of P
+   *         (0 to 63), with the search of all columns being exact or only win/draw/loss.
+   * @param bookDepth: deepest ply of the opening books, -1 if there is none.
+   */
+  static int estimate(const P &pos, int bookDepth, bool weak) {
+    // fitted on random 13 to 30-ply positions (connect4-bench effort 1000 13 30)
+    static constexpr int exact[FEATURES] = {215, 91, 304, -426, -247};
+    static constexpr int wdl[FEATURES] = {181, 81, 289, -379, -229};
+    if(pos.nbMoves() + 1 <= bookDepth) return 0;
+    int f[FEATURES];
+    features(pos, f);
+    return estimate(f, weak ? wdl : exact);
+  }
+};
+
+} // namespace Connect4
+} // namespace GameSolver
+#endif
@@ -230,32 +230,56 @@ extern "C" void memory_free(void **pptr)
 // ----------------------------- C++ operators
 
 
+#ifdef _X86
+// solver instances may be created and destroyed by several threads at once
+static bool memory_lock = false;
+
+static void* locked_alloc(size_t count)
+{
+  while( __atomic_test_and_set(&memory_lock, __ATOMIC_ACQUIRE) );
+  void *p = memory_alloc(count);
+  __atomic_clear(&memory_lock, __ATOMIC_RELEASE);
+  return p;
+}
+
+static void locked_free(void *p)
+{
+  while( __atomic_test_and_set(&memory_lock, __ATOMIC_ACQUIRE) );
+  memory_free(&p);
+  __atomic_clear(&memory_lock, __ATOMIC_RELEASE);
+}
+#else
+#define locked_alloc(count) memory_alloc(count)
+#define locked_free(p)      memory_free(&p)
+#endif
+
+
 void* operator new(size_t count)
 {
-  return memory_alloc(count); 
+  return locked_alloc(count); 
 }
 
 void* operator new[](size_t count)
 {
-  return memory_alloc(count); 
+  return locked_alloc(count); 
 }
 
 void operator delete(void* p)
 {
-  if( p!=NULL ) memory_free(&p);
+  if( p!=NULL ) locked_free(p);
 }
 
 void operator delete(void* p, size_t t)
 {
-  if( p!=NULL ) memory_free(&p);
+  if( p!=NULL ) locked_free(p);
 }
 
 void operator delete[](void* p)
 {
-  if( p!=NULL ) memory_free(&p);
+  if( p!=NULL ) locked_free(p);
 }
 
 void operator delete[](void* p, size_t t)
 {
-  if( p!=NULL ) memory_free(&p);
+  if( p!=NULL ) locked_free(p);
 }
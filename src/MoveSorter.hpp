@@ -31,18 +31,21 @@ namespace Connect4 {
  * then you can get them back in decreasing score
  *
  * This class implement an insertion sort that is in practice very
- * efficient for small number of move to sort (max is Position::WIDTH)
+ * efficient for small number of move to sort (max is P::WIDTH)
  * and also efficient if the move are pushed in approximatively increasing
  * order which can be acheived by using a simpler column ordering heuristic.
+ *
+ * P is the position class the moves belong to (see BasicPosition).
  */
-class MoveSorter {
+template<class P>
+class BasicMoveSorter {
  public:
 
   /**
    * Add a move in the container with its score.
-   * You cannot add more than Position::WIDTH moves
+   * You cannot add more than P::WIDTH moves
    */
-  void add(const Position::position_t move, const int score) {
+  void add(const typename P::position_t move, const int score) {
     int pos = size++;
     for(; pos && entries[pos - 1].score > score; --pos) entries[pos] = entries[pos - 1];
     entries[pos].move = move;
@@ -54,7 +57,7 @@ class MoveSorter {
    * @return next remaining move with max score and remove it from the container.
    * If no more move is available return 0
    */
-  Position::position_t getNext() {
+  typename P::position_t getNext() {
     if(size)
       return entries[--size].move;
     else
@@ -71,7 +74,7 @@ class MoveSorter {
   /**
    * Build an empty container
    */
-  MoveSorter(): size{0} {
+  BasicMoveSorter(): size{0} {
   }
 
  private:
@@ -80,11 +83,13 @@ class MoveSorter {
 
   // Contains size moves with their score ordered by score
   struct {
-    Position::position_t move;
+    typename P::position_t move;
     int score;
-  } entries[Position::WIDTH];
+  } entries[P::WIDTH];
 };
 
+using MoveSorter = BasicMoveSorter<Position>;
+
 } // namespace Connect4
 } // namespace GameSolver
 #endif
@@ -30,37 +30,37 @@ namespace GameSolver {
 namespace Connect4 {
 
 class OpeningBook {
-  TableGetter<Position::position_t, uint8_t> *T;
+  TableGetter<uint64_t, uint8_t> *T; // keyed by base 3 keys (see Position::key3)
   const int width;
   const int height;
   int depth;
 
   template<class partial_key_t>
-  TableGetter<Position::position_t, uint8_t>* initTranspositionTable(int log_size) {
+  TableGetter<uint64_t, uint8_t>* initTranspositionTable(int log_size) {
     switch(log_size) {
     case 18:
-      return new TranspositionTable<partial_key_t, Position::position_t, uint8_t, 18>();
+      return new TranspositionTable<partial_key_t, uint64_t, uint8_t, 18>();
     case 21:
-      return new TranspositionTable<partial_key_t, Position::position_t, uint8_t, 21>();
+      return new TranspositionTable<partial_key_t, uint64_t, uint8_t, 21>();
     case 22:
-      return new TranspositionTable<partial_key_t, Position::position_t, uint8_t, 22>();
+      return new TranspositionTable<partial_key_t, uint64_t, uint8_t, 22>();
     case 23:
-      return new TranspositionTable<partial_key_t, Position::position_t, uint8_t, 23>();
+      return new TranspositionTable<partial_key_t, uint64_t, uint8_t, 23>();
     case 24:
-      return new TranspositionTable<partial_key_t, Position::position_t, uint8_t, 24>();
+      return new TranspositionTable<partial_key_t, uint64_t, uint8_t, 24>();
     case 25:
-      return new TranspositionTable<partial_key_t, Position::position_t, uint8_t, 25>();
+      return new TranspositionTable<partial_key_t, uint64_t, uint8_t, 25>();
     case 26:
-      return new TranspositionTable<partial_key_t, Position::position_t, uint8_t, 26>();
+      return new TranspositionTable<partial_key_t, uint64_t, uint8_t, 26>();
     case 27:
-      return new TranspositionTable<partial_key_t, Position::position_t, uint8_t, 27>();
+      return new TranspositionTable<partial_key_t, uint64_t, uint8_t, 27>();
     default:
       //std::cerr << "Unimplemented OpeningBook size: " << log_size << std::endl;
       return 0;
     }
   }
 
-  TableGetter<Position::position_t, uint8_t>* initTranspositionTable(int partial_key_bytes, int log_size) {
+  TableGetter<uint64_t, uint8_t>* initTranspositionTable(int partial_key_bytes, int log_size) {
     switch(partial_key_bytes) {
     case 1:
       return initTranspositionTable<uint8_t>(log_size);
@@ -77,7 +77,7 @@ class OpeningBook {
  public:
   OpeningBook(int width, int height) : T{0}, width{width}, height{height}, depth{ -1} {} // Empty opening book
 
-  OpeningBook(int width, int height, int depth, TableGetter<Position::position_t, uint8_t>* T) : T{T}, width{width}, height{height}, depth{depth} {} // Empty opening book
+  OpeningBook(int width, int height, int depth, TableGetter<uint64_t, uint8_t>* T) : T{T}, width{width}, height{height}, depth{depth} {} // Empty opening book
 
 #ifdef _X86
   void loadFile(const char *filename)
@@ -182,14 +182,20 @@ class OpeningBook {
     depth = _depth; // set it in case of success only, keep -1 in case of failure
   }
 
-  int get(const Position &P) const {
-    if(P.nbMoves() > depth) 
+  /**
+   * Works for any BasicPosition, book keys are the symetric base 3 keys (see key3)
+   * of positions with the width and height of the book.
+   */
+  template<class P>
+  int get(const P &pos) const {
+    if(pos.nbMoves() > depth) 
       return 0;
     else 
-      return T->get(P.key3());
+      return T->get(pos.key3());
   }
 
   bool ok() const { return (depth>0); }
+  int maxDepth() const { return depth; } // -1 if not loaded
 
   ~OpeningBook() {
     delete T;
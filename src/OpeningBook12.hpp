@@ -13,9 +13,14 @@
 namespace GameSolver {
 namespace Connect4 {
 
+/**
+ * Complete 12-move opening book of the standard 7x6 board.
+ * Stays empty (get returns 0) for any other board size.
+ */
 class OpeningBook12 {
   int  *book;
   signed char *vals;
+  const bool supported; // book format only exists for 7x6 boards
 
  private:
   int getValue(int codedPos, int codedPosMirrored) const
@@ -50,7 +55,7 @@ class OpeningBook12 {
   }
 
  public:
-  OpeningBook12(int width, int height) { book=NULL; vals=NULL; } // Empty opening book
+  OpeningBook12(int width, int height) : supported{width==7 && height==6} { book=NULL; vals=NULL; } // Empty opening book
   ~OpeningBook12() {}
   
 #ifdef _X86
@@ -77,7 +82,7 @@ class OpeningBook12 {
   void setData(const unsigned char *data, size_t len)
   {
     // check data size
-    if( len < BOOKSIZE*5 ) return;
+    if( !supported || len < BOOKSIZE*5 ) return;
 
     book = (int*) data;
     vals = (signed char  *) (data+(sizeof(int)*BOOKSIZE));
@@ -85,15 +90,16 @@ class OpeningBook12 {
 
   bool ok() const { return (book!=NULL) && (vals!=NULL); }
 
-  int get(const Position &P) const 
+  template<class P>
+  int get(const P &pos) const 
   {
-    if( book==NULL || vals==NULL || P.nbMoves() != 12 )
+    if( book==NULL || vals==NULL || pos.nbMoves() != 12 )
       return 0;
     else
       {
         // get huffman code for the position
         int huffman, huffmanM;
-        P.getHuffman(huffman, huffmanM);
+        pos.getHuffman(huffman, huffmanM);
 
         // get distance value from huffman coded database:
         //  97: current player will win in two moves
@@ -103,30 +109,39 @@ class OpeningBook12 {
         // ...
         // -96: other player will win in three moves
         // -97: other player will win in four moves
-        int r, n = getValue(huffman, huffmanM);
-        
-        // convert distance to our representation (Position::MIN_SCORE=-18)
-        //   1: other player will win with their 21st piece
-        //   2: other player will win with their 20th piece
-        //  ...
-        //  18: other player will win with their 4th piece
-        //  19: game is a draw
-        //  20: current player will win with their 21st piece
-        //  21: current player will win with their 20th piece
-        //  ...
-        //  37: current player will win with their 4th piece
-        if( n<0 ) 
-          r = -22 - ((-100 - n - P.nbMoves()) / 2);
-        else if( n>0 )
-          r =  22 - ( (101 - n + P.nbMoves()) / 2);
-        else if( P.canWinNext() )
-          r = 15; // current player wins in next move (not in database)
-        else
-          r = 0; // draw (not in database)
-
-        return r - Position::MIN_SCORE + 1;
+        return distanceToValue(pos, getValue(huffman, huffmanM));
       }
   }
+
+  /**
+   * Convert a value of the book for pos to the encoding of get (score - P::MIN_SCORE + 1).
+   */
+  template<class P>
+  static int distanceToValue(const P &pos, int n)
+  {
+    int r;
+
+    // convert distance to our representation (Position::MIN_SCORE=-18)
+    //   1: other player will win with their 21st piece
+    //   2: other player will win with their 20th piece
+    //  ...
+    //  18: other player will win with their 4th piece
+    //  19: game is a draw
+    //  20: current player will win with their 21st piece
+    //  21: current player will win with their 20th piece
+    //  ...
+    //  37: current player will win with their 4th piece
+    if( n<0 ) 
+      r = -22 - ((-100 - n - pos.nbMoves()) / 2);
+    else if( n>0 )
+      r =  22 - ( (101 - n + pos.nbMoves()) / 2);
+    else if( pos.canWinNext() )
+      r = 15; // current player wins in next move (not in database)
+    else
+      r = 0; // draw (not in database)
+
+    return r - P::MIN_SCORE + 1;
+  }
 };
 
 } // namespace Connect4
@@ -0,0 +1,185 @@
+/*
+ * This file is part of Connect4 Game Solver <http://connect4.gamesolver.org>
+ * Copyright (C) 2017-2019 Pascal Pons <contact@gamesolver.org>
+ *
+ * Connect4 Game Solver is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Connect4 Game Solver is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Connect4 Game Solver. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PARALLEL_PROBES_HPP
+#define PARALLEL_PROBES_HPP
+
+#include <pthread.h>
+#include "Solver.hpp"
+
+namespace GameSolver {
+namespace Connect4 {
+
+/**
+ * Solver running the null window probes of a root search in parallel threads (x86 only):
+ * instead of one probe after the other, each thread searches a different probe value of
+ * [min;max[ at once, the nearest to the next MTDF probe that no other thread searches.
+ * Each result narrows [min;max[ for all threads, probes left outside are cancelled.
+ * This also speeds up the search of a single column, which splitting the tree by root
+ * moves can not.
+ *
+ * The threads share the transposition table and the books of the solver, each having a
+ * solver of its own for its search stack, node count and near-leaf table. Threads only
+ * share single-word table entries safely: when S::SHARED_TABLE is false (default table
+ * layout, see Solver.hpp TABLE_SHARED) the probes are run one after the other (solver_create
+ * warns about it).
+ * Has the members of S used by the query functions of Solver.cpp.
+ */
+template<class S>
+class ParallelProbes {
+ public:
+  using Position = typename S::Position;
+  static constexpr int NO_GUESS = S::NO_GUESS;
+  static constexpr int MAX_THREADS = 16;
+  static constexpr unsigned long long SLICE = 4096; // nodes searched between checks of the bounds
+
+ private:
+  S &solver;
+  int threads;
+  S *helpers[MAX_THREADS]; // solver of each thread, helpers[0] is solver
+
+  // state of the current search, under lock
+  pthread_mutex_t lock;
+  pthread_cond_t changed;  // signaled when the bounds change
+  Position root;
+  int min, max;            // bounds of the root score
+  int med;                 // next MTDF probe
+  int probes[MAX_THREADS]; // probe searched by each thread, NO_GUESS if none
+
+  struct Job {
+    ParallelProbes *parent;
+    int id;
+  } jobs[MAX_THREADS];
+
+  // untaken probe value of [min;max[ nearest to med, NO_GUESS if all are taken
+  int nextProbe() const {
+    const int m = med < min ? min : med >= max ? max - 1 : med;
+    for(int d = 0; m + d < max || m - d >= min; d++)
+      for(int p = m + d; p >= m - d; p -= (d ? 2 * d : 1)) {
+        if(p < min || p >= max) continue;
+        bool taken = false;
+        for(int i = 0; i < threads; i++) taken |= probes[i] == p;
+        if(!taken) return p;
+      }
+    return NO_GUESS;
+  }
+
+  // r is the result of probe p
+  void probeDone(int p, int r) {
+    if(r <= p) {
+      if(r < max) max = r;
+      med = r - 1;
+    } else {
+      if(r > min) min = r;
+      med = r;
+    }
+    pthread_cond_broadcast(&changed);
+  }
+
+  void run(int id) {
+    S &s = *helpers[id];
+    pthread_mutex_lock(&lock);
+    while(min < max) {
+      const int p = nextProbe();
+      if(p == NO_GUESS) { // all the values left are searched by other threads
+        pthread_cond_wait(&changed, &lock);
+        continue;
+      }
+      probes[id] = p;
+      pthread_mutex_unlock(&lock);
+
+      int r;
+      bool done = s.startProbe(root, p, r);
+      bool cancelled = false;
+      while(!done && !cancelled) {
+        done = s.resumeProbe(SLICE, r);
+        pthread_mutex_lock(&lock);
+        cancelled = p < min || p >= max; // the probe can not narrow the bounds any more
+        pthread_mutex_unlock(&lock);
+      }
+
+      pthread_mutex_lock(&lock);
+      probes[id] = NO_GUESS;
+      if(done) probeDone(p, r);
+      else pthread_cond_broadcast(&changed); // p is free again
+    }
+    pthread_mutex_unlock(&lock);
+  }
+
+  static void *thread(void *arg) {
+    Job *job = (Job *) arg;
+    job->parent->run(job->id);
+    return NULL;
+  }
+
+ public:
+  /**
+   * Parallel probes with the given number of threads (1 to MAX_THREADS), the calling one included.
+   * The settings of solver (see BasicSolver(BasicSolver *)) are copied to the other threads now.
+   */
+  ParallelProbes(S &solver, int threads) : solver(solver), threads{threads < 1 ? 1 : threads > MAX_THREADS ? MAX_THREADS : threads} {
+    if(!S::SHARED_TABLE) this->threads = 1;
+    helpers[0] = &solver;
+    for(int i = 1; i < this->threads; i++) helpers[i] = new S(&solver);
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&changed, NULL);
+  }
+
+  ParallelProbes(const ParallelProbes &) = delete;
+  ParallelProbes &operator=(const ParallelProbes &) = delete;
+
+  ~ParallelProbes() {
+    for(int i = 1; i < threads; i++) delete helpers[i];
+    pthread_mutex_destroy(&lock);
+    pthread_cond_destroy(&changed);
+  }
+
+  // same as S::solve, the probes being run by all the threads
+  int solve(const Position &P, bool weak = false, int guess = NO_GUESS) {
+    if(threads == 1) return solver.solve(P, weak, guess);
+
+    // bounds of the score as in S::solve
+    if(P.canWinNext()) return weak ? 1 : (Position::WIDTH * Position::HEIGHT + 1 - P.nbMoves()) / 2;
+    root = P;
+    min = weak ? -1 : -(Position::WIDTH * Position::HEIGHT - P.nbMoves()) / 2;
+    max = weak ? 1 : (Position::WIDTH * Position::HEIGHT + 1 - P.nbMoves()) / 2;
+    med = solver.firstProbe(P, weak, guess); // first probe of S::solve, e.g. the bound stored in the table
+    for(int i = 0; i < threads; i++) probes[i] = NO_GUESS;
+
+    pthread_t ids[MAX_THREADS];
+    for(int i = 0; i < threads; i++) jobs[i] = {this, i};
+    for(int i = 1; i < threads; i++) pthread_create(&ids[i], NULL, thread, &jobs[i]);
+    run(0);
+    for(int i = 1; i < threads; i++) pthread_join(ids[i], NULL);
+    return weak ? (min > 0) - (min < 0) : min;
+  }
+
+  void resetNodeCount() {
+    for(int i = 0; i < threads; i++) helpers[i]->resetNodeCount();
+  }
+
+  unsigned long long getNodeCount() const {
+    unsigned long long n = 0;
+    for(int i = 0; i < threads; i++) n += helpers[i]->getNodeCount();
+    return n;
+  }
+};
+
+} // namespace Connect4
+} // namespace GameSolver
+#endif
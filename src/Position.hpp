@@ -21,6 +21,8 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <type_traits>
+#include "Bitboard.hpp"
 
 namespace GameSolver {
 namespace Connect4 {
@@ -80,15 +82,16 @@ namespace Connect4 {
  */
 
 
-class Position {
+template<int width, int height, class board_type = Bitboard::board_t<width * (height + 1)>>
+class BasicPosition {
  public:
-  static constexpr int WIDTH = 7;  // width of the board
-  static constexpr int HEIGHT = 6; // height of the board
+  static constexpr int WIDTH = width;   // width of the board
+  static constexpr int HEIGHT = height; // height of the board
 
   // Board size is 64bits or 128 bits depending on WIDTH and HEIGHT
-  //using position_t = typename std::conditional < WIDTH * (HEIGHT + 1) <= 64, uint64_t, __int128>::type;
-  // __int128 is a g++ non portable type. Use the following line limited to 64bits board for C++ compatibility
-  using position_t = uint64_t;
+  // (128 bits boards need a compiler providing unsigned __int128, see Bitboard.hpp).
+  // 64 bits boards can also be held in two 32-bit words (Bitboard::SplitBoard)
+  using position_t = board_type;
 
   static constexpr int MIN_SCORE = -(WIDTH*HEIGHT) / 2 + 3;
   static constexpr int MAX_SCORE = (WIDTH * HEIGHT + 1) / 2 - 3;
@@ -121,7 +124,7 @@ class Position {
     unsigned int i;
     for(i = 0; seq[i]!=0 ; i++) {
       int col = seq[i] - '1';
-      if(col < 0 || col >= Position::WIDTH || !canPlay(col) || isWinningMove(col))  return false; // invalid move
+      if(col < 0 || col >= WIDTH || !canPlay(col) || isWinningMove(col))  return false; // invalid move
       playCol(col);
     }
     return true;
@@ -131,7 +134,7 @@ class Position {
    * return true if current player can win next move
    */
   bool canWinNext() const {
-    return winning_position() & possible();
+    return (winning_position() & possible()) != 0;
   }
 
 
@@ -149,6 +152,27 @@ class Position {
     return current_position + mask;
   }
 
+  /**
+   * @return a key shared by the position and its mirror image: the smallest of key()
+   * and the key of the mirror image. mirrored is set if it is the key of the mirror image.
+   */
+  position_t symmetricKey(bool &mirrored) const {
+    const position_t k = key();
+    position_t m = 0;
+    for(int c = 0; c < WIDTH; c++)
+      m |= ((k >> (c * (HEIGHT + 1))) & ((position_t(1) << (HEIGHT + 1)) - 1)) << ((WIDTH - 1 - c) * (HEIGHT + 1));
+    mirrored = m < k;
+    return mirrored ? m : k;
+  }
+
+  /**
+   * @return the key of the position reached by playing move (see key()),
+   * without building that position.
+   */
+  position_t keyAfter(position_t move) const {
+    return (current_position ^ mask) + (mask | move);
+  }
+
 
   void getHuffman(int &huffman, int &huffmanMirrored) const
     {
@@ -160,7 +184,7 @@ class Position {
 
       int c, r, curplayer = ((moves&1)!=0);
       huffman = 0;
-      for(c=0; c<7; c++)
+      for(c=0; c<WIDTH; c++)
         {
           position_t m = bottom_mask_col(c);
           for(r=0; (mask&m)!=0; r++)
@@ -179,7 +203,7 @@ class Position {
       huffman <<= 1;
 
       huffmanMirrored = 0;
-      for(c=6; c>=0; c--)
+      for(c=WIDTH-1; c>=0; c--)
         {
           position_t m = bottom_mask_col(c);
           for(r=0; (mask&m)!=0; r++)
@@ -199,17 +223,17 @@ class Position {
     }
 
 
-  void getBoard(int board[7][6]) const
+  void getBoard(int board[WIDTH][HEIGHT]) const
   {
     int r, c;
-    long long m = 1;
+    position_t m = 1;
     int p1 = 1, p2 = 2;
     if( moves&1 ) { p1 = 2; p2 = 1; }
     position_t ckey = current_position; //key();
 
-    for(c=0; c<7; c++)
+    for(c=0; c<WIDTH; c++)
       {
-        for(r=0; r<6; r++)
+        for(r=0; r<HEIGHT; r++)
           {
             if( (mask & m)==0 )
               board[c][r] = 0;
@@ -225,6 +249,40 @@ class Position {
       }
   }
 
+  /**
+   * Set the position from a board in the format of getBoard
+   * (0: empty, 1: stone of the first player, 2: stone of the second player).
+   * @return false (position unchanged) if stones are floating or
+   * the stone counts are not the ones of a game.
+   */
+  bool setBoard(const int board[WIDTH][HEIGHT])
+  {
+    position_t p1 = 0, all = 0, m = 1;
+    int n1 = 0, n2 = 0;
+
+    for(int c=0; c<WIDTH; c++)
+      {
+        for(int r=0; r<HEIGHT; r++)
+          {
+            if( board[c][r]!=0 )
+              {
+                if( r>0 && board[c][r-1]==0 ) return false;
+                all |= m;
+                if( board[c][r]==1 ) { p1 |= m; n1++; } else n2++;
+              }
+            m = m << 1;
+          }
+
+        m = m << 1;
+      }
+
+    if( n1!=n2 && n1!=n2+1 ) return false;
+    moves = n1 + n2;
+    mask = all;
+    current_position = (moves&1) ? (all ^ p1) : p1;
+    return true;
+  }
+
   /**
   * Build a symetric base 3 key. Two symetric positions will have the same key.
   *
@@ -238,13 +296,14 @@ class Position {
   *
   * as the last digit is always 0, we omit it and a base 3 key
   * uses N = (nbMoves + nbColums - 1) base 3 digits or N*log2(3) bits.
+  * This only fits in 64 bits for shallow positions (as stored in opening books).
   */
   uint64_t key3() const {
     uint64_t key_forward = 0;
-    for(int i = 0; i < Position::WIDTH; i++) partialKey3(key_forward, i);  // compute key in increasing order of columns
+    for(int i = 0; i < WIDTH; i++) partialKey3(key_forward, i);  // compute key in increasing order of columns
 
     uint64_t key_reverse = 0;
-    for(int i = Position::WIDTH; i--;) partialKey3(key_reverse, i);  // compute key in decreasing order of columns
+    for(int i = WIDTH; i--;) partialKey3(key_reverse, i);  // compute key in decreasing order of columns
 
     return key_forward < key_reverse ? key_forward / 3 : key_reverse / 3; // take the smallest key and divide per 3 as the last base3 digit is always 0
   }
@@ -281,10 +340,18 @@ class Position {
     return popcount(compute_winning_position(current_position | move, mask));
   }
 
+  /**
+   * Score n possible moves at once, scores[i] = moveScore(moves[i]).
+   * Uses the batched kernel selected in Bitboard.hpp (AVX2 lanes when available).
+   */
+  void moveScores(const position_t *moves, int n, int *scores) const {
+    Bitboard::move_scores<HEIGHT>(current_position, mask, board_mask, moves, n, scores);
+  }
+
   /**
    * Default constructor, build an empty position.
    */
-  Position() : current_position{0}, mask{0}, moves{0} {}
+  BasicPosition() : current_position{0}, mask{0}, moves{0} {}
 
   /**
    * Indicates whether a column is playable.
@@ -312,10 +379,13 @@ class Position {
    * @return true if current player makes an alignment by playing the corresponding column col.
    */
   bool isWinningMove(int col) const {
-    return winning_position() & possible() & column_mask(col);
+    return (winning_position() & possible() & column_mask(col)) != 0;
   }
 
  private:
+  template<class P> friend class ThreatRules; // static rules work directly on the bitmaps
+  template<class P> friend class EffortModel; // threat counts of the effort estimate
+
   position_t current_position; // bitmap of the current_player stones
   position_t mask;             // bitmap of all the already palyed spots
   unsigned int moves;        // number of moves played since the beinning of the game.
@@ -324,7 +394,7 @@ class Position {
     * Compute a partial base 3 key for a given column
     */
   void partialKey3(uint64_t &key, int col) const {
-    for(position_t pos = UINT64_C(1) << (col * (Position::HEIGHT + 1)); pos & mask; pos <<= 1) {
+    for(position_t pos = position_t(1) << (col * (HEIGHT + 1)); pos & mask; pos <<= 1) {
       key *= 3;
       if(pos & current_position) key += 1;
       else key += 2;
@@ -356,11 +426,10 @@ class Position {
 
   /**
    * counts number of bit set to one in a 64bits integer
+   * (kernel selected at compile time, see Bitboard.hpp)
    */
   static unsigned int popcount(position_t m) {
-    unsigned int c = 0;
-    for(c = 0; m; c++) m &= m - 1;
-    return c;
+    return Bitboard::popcount(m);
   }
 
   /**
@@ -368,62 +437,39 @@ class Position {
    * @param mask, a mask of the already played spots
    *
    * @return a bitmap of all the winning free spots making an alignment
+   * (kernel selected at compile time, see Bitboard.hpp)
    */
   static position_t compute_winning_position(position_t position, position_t mask) {
-    // vertical;
-    position_t r = (position << 1) & (position << 2) & (position << 3);
-
-    //horizontal
-    position_t p = (position << (HEIGHT + 1)) & (position << 2 * (HEIGHT + 1));
-    r |= p & (position << 3 * (HEIGHT + 1));
-    r |= p & (position >> (HEIGHT + 1));
-    p = (position >> (HEIGHT + 1)) & (position >> 2 * (HEIGHT + 1));
-    r |= p & (position << (HEIGHT + 1));
-    r |= p & (position >> 3 * (HEIGHT + 1));
-
-    //diagonal 1
-    p = (position << HEIGHT) & (position << 2 * HEIGHT);
-    r |= p & (position << 3 * HEIGHT);
-    r |= p & (position >> HEIGHT);
-    p = (position >> HEIGHT) & (position >> 2 * HEIGHT);
-    r |= p & (position << HEIGHT);
-    r |= p & (position >> 3 * HEIGHT);
-
-    //diagonal 2
-    p = (position << (HEIGHT + 2)) & (position << 2 * (HEIGHT + 2));
-    r |= p & (position << 3 * (HEIGHT + 2));
-    r |= p & (position >> (HEIGHT + 2));
-    p = (position >> (HEIGHT + 2)) & (position >> 2 * (HEIGHT + 2));
-    r |= p & (position << (HEIGHT + 2));
-    r |= p & (position >> 3 * (HEIGHT + 2));
-
-    return r & (board_mask ^ mask);
+    return Bitboard::winning_position<HEIGHT>(position, mask, board_mask);
   }
 
   // Static bitmaps
-  template<int width, int height> struct bottom {static constexpr position_t mask = bottom<width-1, height>::mask | position_t(1) << (width - 1) * (height + 1);};
-  template <int height> struct bottom<0, height> {static constexpr position_t mask = 0;};
+  template<int w, int h> struct bottom {static constexpr position_t mask = bottom<w-1, h>::mask | position_t(1) << (w - 1) * (h + 1);};
+  template <int h> struct bottom<0, h> {static constexpr position_t mask = 0;};
 
   static constexpr position_t bottom_mask = bottom<WIDTH, HEIGHT>::mask;
   static constexpr position_t board_mask = bottom_mask * ((1LL << HEIGHT) - 1);
 
   // return a bitmask containg a single 1 corresponding to the top cel of a given column
   static constexpr position_t top_mask_col(int col) {
-    return UINT64_C(1) << ((HEIGHT - 1) + col * (HEIGHT + 1));
+    return position_t(1) << ((HEIGHT - 1) + col * (HEIGHT + 1));
   }
 
   // return a bitmask containg a single 1 corresponding to the bottom cell of a given column
   static constexpr position_t bottom_mask_col(int col) {
-    return UINT64_C(1) << col * (HEIGHT + 1);
+    return position_t(1) << col * (HEIGHT + 1);
   }
 
  public:
   // return a bitmask 1 on all the cells of a given column
   static constexpr position_t column_mask(int col) {
-    return ((UINT64_C(1) << HEIGHT) - 1) << col * (HEIGHT + 1);
+    return ((position_t(1) << HEIGHT) - 1) << col * (HEIGHT + 1);
   }
 };
 
+// the standard 7x6 board
+using Position = BasicPosition<7, 6>;
+
 } // namespace Connect4
 } // namespace GameSolver
 #endif
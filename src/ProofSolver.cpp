@@ -0,0 +1,231 @@
+/*
+ * This file is part of Connect4 Game Solver <http://connect4.gamesolver.org>
+ * Copyright (C) 2017-2019 Pascal Pons <contact@gamesolver.org>
+ *
+ * Connect4 Game Solver is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Connect4 Game Solver is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Connect4 Game Solver. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ProofSolver.hpp"
+#include "utils.h"
+
+// act_led is defined in main.c
+extern "C" void act_led(int on);
+
+namespace GameSolver {
+namespace Connect4 {
+
+template<int width, int height>
+typename BasicProofSolver<width, height>::Entry *BasicProofSolver<width, height>::bucket(const position_t &key) const {
+  const uint64_t k = uint64_t(key) ^ uint64_t(key >> 32 >> 32); // keys above 64 bits are folded
+  return table + ((k * UINT64_C(0x9E3779B97F4A7C15)) >> (64 - (TABLE_SIZE - 1))) * 2;
+}
+
+template<int width, int height>
+bool BasicProofSolver<width, height>::lookup(const Position &P, bool strict, uint32_t &proof, uint32_t &disproof) const {
+  const position_t key = P.key();
+  const Entry *e = bucket(key);
+  if(e->key != key && (++e)->key != key) return false;
+
+  if(e->strict == strict) {
+    proof = e->proof;
+    disproof = e->disproof;
+    return true;
+  }
+  if(e->strict && e->proof == 0) { // a win is also at least a draw
+    proof = 0;
+    disproof = INFINITE;
+    return true;
+  }
+  if(!e->strict && e->disproof == 0) { // a loss is not a win
+    proof = INFINITE;
+    disproof = 0;
+    return true;
+  }
+  return false;
+}
+
+template<int width, int height>
+void BasicProofSolver<width, height>::store(const Position &P, bool strict, uint32_t proof, uint32_t disproof, uint32_t work) {
+  const position_t key = P.key();
+  Entry *e = bucket(key);
+  if(e->key != key && (e[1].key == key || e[1].work < e->work)) e++; // same position, else the entry with less work
+  e->key = key;
+  e->proof = proof;
+  e->disproof = disproof;
+  e->work = work;
+  e->strict = strict;
+}
+
+template<int width, int height>
+bool BasicProofSolver<width, height>::evaluate(const Position &P, bool strict, uint32_t &proof, uint32_t &disproof) {
+  nodeCount++;
+  if( (nodeCount&0x7fff)==0 ) act_led((nodeCount & 0x8000) ? 0 : 1);
+
+  // score bounds of negamax: lost if no non losing move, draw when the board is (almost) full
+  int min = -(Position::WIDTH * Position::HEIGHT - 2 - P.nbMoves()) / 2;
+  int max = (Position::WIDTH * Position::HEIGHT - 1 - P.nbMoves()) / 2;
+  const position_t possible = P.possibleNonLosingMoves();
+  if(possible == 0) min = max = -1;
+  else if(P.nbMoves() >= Position::WIDTH * Position::HEIGHT - 2) min = max = 0;
+  else if(max > 0 && ThreatRules<Position>::cannotWin(P)) max = 0;
+
+  if(min < max && (P.nbMoves() <= 12 || P.nbMoves() <= books->books.maxDepth())) // opening positions, see BasicSolver::isOpening
+    if(int val = books->get(P)) min = max = val + Position::MIN_SCORE - 1;
+
+  const int goal = strict ? 1 : 0; // the player to move needs score >= goal
+  if(min >= goal) {
+    proof = 0;
+    disproof = INFINITE;
+    return true;
+  }
+  if(max < goal) {
+    proof = INFINITE;
+    disproof = 0;
+    return true;
+  }
+  proof = 1; // one move has to reach the goal, all of them have to fail
+  disproof = Bitboard::popcount(possible);
+  return false;
+}
+
+template<int width, int height>
+void BasicProofSolver<width, height>::search(const Position &P, bool strict, uint32_t thProof, uint32_t thDisproof, uint32_t &proof, uint32_t &disproof) {
+  const unsigned long long start = nodeCount;
+  Position children[Position::WIDTH];
+  uint32_t proofs[Position::WIDTH], disproofs[Position::WIDTH]; // numbers of the children for the goal of the opponent
+  int n = 0;
+
+  // children ordered as in negamax, ties between their numbers go to the first one
+  MoveSorter moves;
+  const position_t possible = P.possibleNonLosingMoves();
+  for(int i = Position::WIDTH; i--;)
+    if(const position_t move = possible & Position::column_mask(columnOrder[i]))
+      moves.add(move, P.moveScore(move));
+  while(const position_t move = moves.getNext()) {
+    children[n] = P;
+    children[n].play(move);
+    if(!lookup(children[n], !strict, proofs[n], disproofs[n])) {
+      if(evaluate(children[n], !strict, proofs[n], disproofs[n])) store(children[n], !strict, proofs[n], disproofs[n], 0);
+    }
+    n++;
+  }
+
+  while(true) {
+    // the goal holds if it holds for one move, it fails if it fails for all of them
+    int best = 0;
+    uint32_t second = INFINITE; // second smallest disproof number of the children
+    uint64_t sum = 0;
+    proof = INFINITE;
+    for(int i = 0; i < n; i++) {
+      if(disproofs[i] < proof) {
+        second = proof;
+        proof = disproofs[i];
+        best = i;
+      }
+      else if(disproofs[i] < second) second = disproofs[i];
+      sum += proofs[i];
+    }
+    disproof = proof == 0 ? INFINITE : sum < INFINITE ? uint32_t(sum) : INFINITE - 1;
+
+    if(proof >= thProof || disproof >= thDisproof || nodeCount >= nodeLimit) break;
+
+    // thresholds of the best child: its proof number must keep the disproof number of P below
+    // thDisproof, its disproof number must stay below thProof and a bit above the one of the second
+    // best child (1+epsilon trick: fewer switches between the two best children)
+    const uint32_t childThProof = thDisproof - (disproof - proofs[best]);
+    const uint32_t limit = second + second / 4 + 1;
+    const uint32_t childThDisproof = thProof < limit ? thProof : limit;
+    search(children[best], !strict, childThProof, childThDisproof, proofs[best], disproofs[best]);
+  }
+
+  const unsigned long long work = nodeCount - start;
+  store(P, strict, proof, disproof, work > 0xffffffffULL ? 0xffffffffU : uint32_t(work));
+}
+
+template<int width, int height>
+int BasicProofSolver<width, height>::solve(const Position &P) {
+  int score;
+  startSolve(P);
+  resumeSolve(~0ULL, score);
+  return score;
+}
+
+template<int width, int height>
+void BasicProofSolver<width, height>::startSolve(const Position &P) {
+  root = P;
+  strict = true;
+  done = false;
+  if(P.canWinNext()) { // evaluate and search do not support this case (see negamax)
+    done = true;
+    result = 1;
+  }
+}
+
+template<int width, int height>
+bool BasicProofSolver<width, height>::resumeSolve(unsigned long long maxNodes, int &score) {
+  nodeLimit = maxNodes > ~0ULL - nodeCount ? ~0ULL : nodeCount + maxNodes;
+  while(!done) {
+    uint32_t proof, disproof;
+    const bool settled = lookup(root, strict, proof, disproof) && (proof == 0 || disproof == 0);
+    if(!settled && !evaluate(root, strict, proof, disproof))
+      search(root, strict, INFINITE, INFINITE, proof, disproof);
+
+    if(proof == 0) { // score > 0, or score >= 0 after the first search failed
+      done = true;
+      result = strict ? 1 : 0;
+    }
+    else if(disproof == 0) {
+      if(strict) strict = false; // not a win: is it a draw?
+      else {
+        done = true;
+        result = -1;
+      }
+    }
+    else return false; // node limit reached
+  }
+  score = result;
+  return true;
+}
+
+template<int width, int height>
+void BasicProofSolver<width, height>::reset() {
+  for(size_t i = 0; i < (size_t(1) << TABLE_SIZE); i++) {
+    table[i].key = 0;
+    table[i].work = 0;
+  }
+}
+
+template<int width, int height>
+BasicProofSolver<width, height>::BasicProofSolver() : books{&ownBooks}, nodeCount{0}, nodeLimit{~0ULL}, strict{true}, done{true}, result{0} {
+  table = new Entry[size_t(1) << TABLE_SIZE];
+  reset();
+  for(int i = 0; i < Position::WIDTH; i++) // same column exploration order as the solver, starting with center columns
+    columnOrder[i] = Position::WIDTH / 2 + (1 - 2 * (i % 2)) * (i + 1) / 2;
+}
+
+template<int width, int height>
+BasicProofSolver<width, height>::~BasicProofSolver() {
+  delete[] table;
+}
+
+// supported board sizes
+template class BasicProofSolver<7, 6>;
+#ifdef _X86
+template class BasicProofSolver<6, 5>;
+template class BasicProofSolver<8, 7>;
+template class BasicProofSolver<9, 7>;
+#endif
+
+} // namespace Connect4
+} // namespace GameSolver
@@ -0,0 +1,192 @@
+/*
+ * This file is part of Connect4 Game Solver <http://connect4.gamesolver.org>
+ * Copyright (C) 2017-2019 Pascal Pons <contact@gamesolver.org>
+ *
+ * Connect4 Game Solver is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Connect4 Game Solver is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Connect4 Game Solver. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PROOF_SOLVER_HPP
+#define PROOF_SOLVER_HPP
+
+#include "Solver.hpp"
+
+namespace GameSolver {
+namespace Connect4 {
+
+/**
+ * Depth-first proof-number search (df-pn) for win/draw/loss: a first search proves or
+ * disproves that the player to move wins (score > 0), a second one, if needed, that it
+ * does not lose (score >= 0). The exact score is never computed.
+ *
+ * Each node has a proof number (number of leaves still to prove for the goal of the player
+ * to move to hold) and a disproof number, kept in a table of their own: the proof number of
+ * a node is the smallest disproof number of its children, its disproof number the sum of
+ * the proof numbers of its children. The search always expands the child with the smallest
+ * disproof number, going back up when the numbers of the node exceed its thresholds.
+ * Leaves are settled with the same rules as negamax: non losing moves, bounds of the score,
+ * static threat rules and opening books.
+ *
+ * The search can be run in slices of nodes (see startSolve), to be raced against the
+ * iterative engine of BasicSolver (see ProofRace).
+ */
+template<int width, int height>
+class BasicProofSolver {
+ public:
+  using Position = BasicPosition<width, height>;
+  using position_t = typename Position::position_t;
+  using MoveSorter = BasicMoveSorter<Position>;
+  using Books = BasicBooks<width, height>;
+
+  static constexpr int TABLE_SIZE = 20; // 2^TABLE_SIZE entries in the table of proof and disproof numbers
+
+ private:
+  static constexpr uint32_t INFINITE = 1u << 30; // proof number of a disproven node, disproof number of a proven one
+
+  // proof and disproof numbers of a position for the goal of the player to move:
+  // a win (score > 0) if strict, else at least a draw (score >= 0)
+  struct Entry {
+    position_t key;    // 0 for an empty entry
+    uint32_t proof, disproof;
+    uint32_t work;     // number of nodes searched to compute the numbers, the entry of a bucket
+                       // with the smaller work is replaced
+    bool strict;
+  };
+  Entry *table;        // 2-entry buckets
+
+  Books ownBooks;      // no books unless loaded or shared (see setBooks)
+  const Books *books;
+  unsigned long long nodeCount, nodeLimit;
+  int columnOrder[Position::WIDTH];
+
+  // state of the search started by startSolve
+  Position root;
+  bool strict;         // goal of the current search: score > 0, then score >= 0
+  bool done;
+  int result;          // -1, 0 or 1 once done
+
+  Entry *bucket(const position_t &key) const;
+
+  // proof and disproof numbers of P from the table, false if unknown
+  bool lookup(const Position &P, bool strict, uint32_t &proof, uint32_t &disproof) const;
+  void store(const Position &P, bool strict, uint32_t proof, uint32_t disproof, uint32_t work);
+
+  /**
+   * Settle P without search if possible (one more node is counted).
+   * P must not have an immediate win for the player to move.
+   * @return true if the goal is proven (proof = 0) or disproven (disproof = 0), else
+   * proof and disproof are initialised to 1 and the number of non losing moves.
+   */
+  bool evaluate(const Position &P, bool strict, uint32_t &proof, uint32_t &disproof);
+
+  /**
+   * Search P, an unsettled position, until its proof number reaches thProof, its disproof
+   * number reaches thDisproof or the node count reaches nodeLimit.
+   * The numbers of P are then in proof and disproof, and in the table.
+   */
+  void search(const Position &P, bool strict, uint32_t thProof, uint32_t thDisproof, uint32_t &proof, uint32_t &disproof);
+
+ public:
+  /**
+   * Win/draw/loss of a position (see BasicSolver::negamax for the assumptions).
+   * @return 1, 0 or -1, the sign of the score of P.
+   */
+  int solve(const Position &P);
+
+  /**
+   * Start solving P without exploring any node yet, call resumeSolve() to do the search.
+   */
+  void startSolve(const Position &P);
+
+  /**
+   * Continue the search started by startSolve() for about maxNodes nodes.
+   * @return true when the search is done, the sign of the score of P is then in score.
+   */
+  bool resumeSolve(unsigned long long maxNodes, int &score);
+
+  void resetNodeCount() {
+    nodeCount = 0;
+  }
+
+  unsigned long long getNodeCount() const {
+    return nodeCount;
+  }
+
+  // empty the table of proof and disproof numbers
+  void reset();
+
+  OpeningBook &getBook() { return ownBooks.book; }
+  OpeningBook12 &getBook12() { return ownBooks.book12; }
+  BookContainer &getBooks() { return ownBooks.books; }
+
+  /**
+   * Look up shared books instead of the own ones (NULL: back to the own books).
+   * They must stay valid and unchanged while the solver uses them.
+   */
+  void setBooks(const Books *shared) {
+    books = shared ? shared : &ownBooks;
+  }
+
+  BasicProofSolver();
+  ~BasicProofSolver();
+};
+
+// proof-number solver for the standard 7x6 board
+using ProofSolver = BasicProofSolver<7, 6>;
+
+/**
+ * Solver answering win/draw/loss searches by racing a proof-number solver against the
+ * iterative engine of a negamax solver, in alternate slices of nodes on the calling thread:
+ * the first one to settle the position gives the answer. Exact searches are left to the
+ * negamax solver. Both solvers keep what they stored in their tables.
+ * Has the members of S used by the query functions of Solver.cpp.
+ */
+template<class S>
+class ProofRace {
+ public:
+  using Position = typename S::Position;
+  using Proof = BasicProofSolver<Position::WIDTH, Position::HEIGHT>;
+  static constexpr int NO_GUESS = S::NO_GUESS;
+  static constexpr unsigned long long SLICE = 10000; // nodes searched by each solver in turn
+
+ private:
+  S &solver;
+  Proof &proof;
+
+ public:
+  ProofRace(S &solver, Proof &proof) : solver(solver), proof(proof) {}
+
+  int solve(const Position &P, bool weak = false, int guess = NO_GUESS) {
+    if(!weak) return solver.solve(P, false, guess);
+
+    int score;
+    solver.startSolve(P, true, guess);
+    proof.startSolve(P);
+    while(!proof.resumeSolve(SLICE, score))
+      if(solver.resumeSolve(SLICE, score)) break;
+    return score;
+  }
+
+  void resetNodeCount() {
+    solver.resetNodeCount();
+    proof.resetNodeCount();
+  }
+
+  unsigned long long getNodeCount() const {
+    return solver.getNodeCount() + proof.getNodeCount();
+  }
+};
+
+} // namespace Connect4
+} // namespace GameSolver
+#endif
@@ -0,0 +1,177 @@
+/*
+ * This file is part of Connect4 Game Solver <http://connect4.gamesolver.org>
+ * Copyright (C) 2017-2019 Pascal Pons <contact@gamesolver.org>
+ *
+ * Connect4 Game Solver is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Connect4 Game Solver is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Connect4 Game Solver. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SEARCH_TRACE_HPP
+#define SEARCH_TRACE_HPP
+
+#ifdef _X86
+#include <stdio.h>
+#endif
+
+#include <cstdint>
+#include <cstddef>
+
+namespace GameSolver {
+namespace Connect4 {
+
+/**
+ * Events of the search recorded by the trace mode of the solver (build with -DSOLVER_TRACE,
+ * see connect4-trace for the flame graph and per-ply summaries).
+ *
+ * File format: 16 bytes header (magic "C4TR", version TRACE_VERSION, board width, board
+ * height, 9 reserved bytes), then the events in order, 12 bytes each:
+ * - 4 bytes: nodes explored since the previous event (little endian)
+ * - 1 byte: type
+ * - 1 byte: ply (number of moves of the position)
+ * - 1 byte: alpha, 1 byte: beta (signed)
+ * - 1 byte: value (signed), see below
+ * - 3 bytes reserved
+ *
+ * TRACE_ENTER:      a node is entered with window [alpha;beta]
+ * TRACE_EXIT:       the node is left, value is its score
+ * TRACE_MOVE:       the next child of the node is entered, value is its column (0-based)
+ * TRACE_TABLE_HIT:  the node has a transposition table entry, value is the stored bound,
+ *                   alpha and beta the window it leaves
+ * TRACE_TABLE_MISS: the node has no transposition table entry
+ * TRACE_BOOK_HIT:   the score of the node, value, is found in an opening book
+ */
+#define TRACE_VERSION    1
+#define TRACE_ENTER      1
+#define TRACE_EXIT       2
+#define TRACE_MOVE       3
+#define TRACE_TABLE_HIT  4
+#define TRACE_TABLE_MISS 5
+#define TRACE_BOOK_HIT   6
+
+struct TraceEvent {
+  uint32_t nodes;
+  uint8_t type;
+  uint8_t ply;
+  int8_t alpha, beta;
+  int8_t value;
+  uint8_t reserved[3];
+};
+
+/**
+ * Ring buffer of the last trace events. On x86 the events can instead all be
+ * written to a file, the buffer being written each time it is full.
+ */
+class SearchTrace {
+  TraceEvent *events;
+  size_t size;
+  size_t count; // number of events in the buffer
+  size_t total; // number of events recorded
+  unsigned long long lastNodes;
+#ifdef _X86
+  FILE *file;
+#endif
+
+ public:
+  SearchTrace(size_t size = 1 << 20) : events{new TraceEvent[size]}, size{size}, count{0}, total{0}, lastNodes{0} {
+#ifdef _X86
+    file = NULL;
+#endif
+  }
+
+  ~SearchTrace() {
+#ifdef _X86
+    close();
+#endif
+    delete[] events;
+  }
+
+  void record(int type, int ply, int alpha, int beta, int value, unsigned long long nodeCount) {
+    TraceEvent &e = events[total % size];
+    unsigned long long delta = nodeCount - lastNodes;
+    e.nodes = delta > 0xffffffffULL ? 0xffffffffU : uint32_t(delta);
+    e.type = type;
+    e.ply = ply;
+    e.alpha = alpha;
+    e.beta = beta;
+    e.value = value;
+    e.reserved[0] = e.reserved[1] = e.reserved[2] = 0;
+    lastNodes = nodeCount;
+    total++;
+    if(count < size) count++;
+#ifdef _X86
+    if(file && count == size) {
+      fwrite(events, sizeof(TraceEvent), size, file);
+      count = 0;
+    }
+#endif
+  }
+
+  // forget the events in the buffer, nodeCount being the current node count of the solver
+  void clear(unsigned long long nodeCount) {
+    count = total = 0;
+    lastNodes = nodeCount;
+  }
+
+  size_t getCount() const { return count; }
+  size_t getTotal() const { return total; }
+
+  // i-th event in the buffer, oldest first
+  const TraceEvent &get(size_t i) const {
+    return events[(total - count + i) % size];
+  }
+
+#ifdef _X86
+  static void writeHeader(FILE *f, int width, int height) {
+    unsigned char header[16] = {'C', '4', 'T', 'R', TRACE_VERSION, (unsigned char)width, (unsigned char)height};
+    fwrite(header, 1, 16, f);
+  }
+
+  /**
+   * Write all the following events to a file (closing any previous one).
+   * @return false if the file cannot be created.
+   */
+  bool open(const char *filename, int width, int height) {
+    close();
+    file = fopen(filename, "wb");
+    if(file == NULL) return false;
+    writeHeader(file, width, height);
+    count = 0; // the buffer is written whenever full, from its start
+    total = 0;
+    return true;
+  }
+
+  // write the events left in the buffer and close the file
+  void close() {
+    if(file) {
+      fwrite(events, sizeof(TraceEvent), count, file);
+      fclose(file);
+      file = NULL;
+      count = 0;
+    }
+  }
+
+  // write the events of the ring buffer to a file, oldest first
+  bool save(const char *filename, int width, int height) const {
+    FILE *f = fopen(filename, "wb");
+    if(f == NULL) return false;
+    writeHeader(f, width, height);
+    for(size_t i = 0; i < count; i++) fwrite(&get(i), sizeof(TraceEvent), 1, f);
+    fclose(f);
+    return true;
+  }
+#endif
+};
+
+} // namespace Connect4
+} // namespace GameSolver
+#endif
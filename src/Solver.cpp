@@ -17,7 +17,12 @@
  */
 
 #include "Solver.hpp"
-#include "MoveSorter.hpp"
+#include "ProofSolver.hpp"
+#include "AnswerCache.hpp"
+#include "EffortModel.hpp"
+#ifdef _X86
+#include "ParallelProbes.hpp"
+#endif
 #include "utils.h"
 #include "uart.h"
 
@@ -29,79 +34,196 @@ using namespace GameSolver::Connect4;
 namespace GameSolver {
 namespace Connect4 {
 
-/**
- * Reccursively score connect 4 position using negamax variant of alpha-beta algorithm.
- * @param: position to evaluate, this function assumes nobody already won and
- *         current player cannot win next move. This has to be checked before
- * @param: alpha < beta, a score window within which we are evaluating the position.
- *
- * @return the exact score, an upper or lower bound score depending of the case:
- * - if actual score of position <= alpha then actual score <= return value <= alpha
- * - if actual score of position >= beta then beta <= return value <= actual score
- * - if alpha <= actual score <= beta then return value = actual score
- */
-int Solver::negamax(const Position &P, int alpha, int beta) {
+// trace mode (see SearchTrace): record the events of the search, nothing in normal builds
+#ifdef SOLVER_TRACE
+#define TRACE(type, P, alpha, beta, value) trace.record(type, (P).nbMoves(), alpha, beta, value, nodeCount)
+#define TRACE_PLAY(P, move, alpha, beta) TRACE(TRACE_MOVE, P, alpha, beta, moveColumn<Position>(move))
+
+template<class Position>
+static int moveColumn(typename Position::position_t move) {
+  int column = 0;
+  while(!(move & Position::column_mask(column))) column++;
+  return column;
+}
+#else
+#define TRACE(type, P, alpha, beta, value) do {} while(0)
+#define TRACE_PLAY(P, move, alpha, beta) do {} while(0)
+#endif
+
+template<int width, int height>
+int BasicSolver<width, height>::endgame(const Position &P, int alpha, int beta) {
+  nodeCount++; // increment counter of explored nodes
+  if( (nodeCount&0x7fff)==0 ) act_led((nodeCount & 0x8000) ? 0 : 1);
+
+  position_t possible = P.possibleNonLosingMoves();
+  if(possible == 0) return -(Position::WIDTH * Position::HEIGHT - P.nbMoves()) / 2; // opponent wins next move
+  if(P.nbMoves() >= Position::WIDTH * Position::HEIGHT - 2) return 0; // draw game
+
+  int min = -(Position::WIDTH * Position::HEIGHT - 2 - P.nbMoves()) / 2;
+  if(alpha < min) {
+    alpha = min;
+    if(alpha >= beta) return alpha;
+  }
+  int max = (Position::WIDTH * Position::HEIGHT - 1 - P.nbMoves()) / 2;
+  if(beta > max) {
+    beta = max;
+    if(alpha >= beta) return beta;
+  }
+
+  // moves adding winning cells first, then the others, center columns first
+  position_t first[Position::WIDTH], last[Position::WIDTH];
+  int nbFirst = 0, nbLast = 0;
+  const int threats = P.moveScore(0);
+  for(int i = 0; i < Position::WIDTH; i++)
+    if(position_t move = possible & Position::column_mask(columnOrder[i])) {
+      if(P.moveScore(move) > threats) first[nbFirst++] = move;
+      else last[nbLast++] = move;
+    }
+
+  for(int i = 0; i < nbFirst + nbLast; i++) {
+    Position P2(P);
+    P2.play(i < nbFirst ? first[i] : last[i - nbFirst]);
+    int score = -endgame(P2, -beta, -alpha);
+    if(score >= beta) return score;
+    if(score > alpha) alpha = score;
+  }
+  return alpha;
+}
+
+template<int width, int height>
+template<bool opening>
+inline bool BasicSolver<width, height>::enterNode(const Position &P, int &alpha, int &beta, int &score, MoveSorter &moves) {
+  if(!opening && Position::WIDTH * Position::HEIGHT - P.nbMoves() <= endgameCells) {
+    score = endgame(P, alpha, beta); // no table access in the last plies
+    return true;
+  }
+
   nodeCount++; // increment counter of explored nodes
   if( (nodeCount&0x7fff)==0 ) act_led((nodeCount & 0x8000) ? 0 : 1);
 
-  Position::position_t possible = P.possibleNonLosingMoves();
-  if(possible == 0)     // if no possible non losing move, opponent wins next move
-    return -(Position::WIDTH * Position::HEIGHT - P.nbMoves()) / 2;
+  position_t possible = P.possibleNonLosingMoves();
+  if(possible == 0) {   // if no possible non losing move, opponent wins next move
+    score = -(Position::WIDTH * Position::HEIGHT - P.nbMoves()) / 2;
+    return true;
+  }
 
-  if(P.nbMoves() >= Position::WIDTH * Position::HEIGHT - 2) // check for draw game
-    return 0;
+  if(P.nbMoves() >= Position::WIDTH * Position::HEIGHT - 2) { // check for draw game
+    score = 0;
+    return true;
+  }
 
   int min = -(Position::WIDTH * Position::HEIGHT - 2 - P.nbMoves()) / 2;	// lower bound of score as opponent cannot win next move
   if(alpha < min) {
     alpha = min;                     // there is no need to keep alpha below our max possible score.
-    if(alpha >= beta) return alpha;  // prune the exploration if the [alpha;beta] window is empty.
+    if(alpha >= beta) { score = alpha; return true; }  // prune the exploration if the [alpha;beta] window is empty.
   }
 
   int max = (Position::WIDTH * Position::HEIGHT - 1 - P.nbMoves()) / 2;	// upper bound of our score as we cannot win immediately
   if(beta > max) {
     beta = max;                     // there is no need to keep beta above our max possible score.
-    if(alpha >= beta) return beta;  // prune the exploration if the [alpha;beta] window is empty.
+    if(alpha >= beta) { score = beta; return true; }  // prune the exploration if the [alpha;beta] window is empty.
   }
 
-  const Position::position_t key = P.key();
-  if(int val = transTable.get(key)) {
+  const bool near = P.nbMoves() >= nearPly;
+  tableProbes[near]++;
+  if(int val = tableGet(P.nbMoves(), P.key())) {
+    tableHits[near]++;
     if(val > Position::MAX_SCORE - Position::MIN_SCORE + 1) { // we have an lower bound
       min = val + 2 * Position::MIN_SCORE - Position::MAX_SCORE - 2;
+      TRACE(TRACE_TABLE_HIT, P, alpha < min ? min : alpha, beta, min);
       if(alpha < min) {
         alpha = min;                     // there is no need to keep beta above our max possible score.
-        if(alpha >= beta) return alpha;  // prune the exploration if the [alpha;beta] window is empty.
+        if(alpha >= beta) { score = alpha; return true; }  // prune the exploration if the [alpha;beta] window is empty.
       }
     } else { // we have an upper bound
       max = val + Position::MIN_SCORE - 1;
+      TRACE(TRACE_TABLE_HIT, P, alpha, beta > max ? max : beta, max);
       if(beta > max) {
         beta = max;                     // there is no need to keep beta above our max possible score.
-        if(alpha >= beta) return beta;  // prune the exploration if the [alpha;beta] window is empty.
+        if(alpha >= beta) { score = beta; return true; }  // prune the exploration if the [alpha;beta] window is empty.
       }
     }
     }
+  else TRACE(TRACE_TABLE_MISS, P, alpha, beta, 0);
+
+  // claimeven/baseinverse: the opponent may be able to prevent any alignment of ours
+  if(useRules && beta > 0 && ThreatRules<Position>::cannotWin(P)) {
+    beta = 0;
+    if(alpha >= beta) { score = beta; return true; }  // prune the exploration if the [alpha;beta] window is empty.
+  }
+
+  if( opening && P.nbMoves()<=books->books.maxDepth() )
+    {
+      // look for solutions stored in the layers of the book container
+      if(int val = books->books.get(P)) { score = val + Position::MIN_SCORE - 1; TRACE(TRACE_BOOK_HIT, P, alpha, beta, score); return true; }
+    }
 
   // opening books only contain sequences 12 moves or less, 
   // save time by not looking for longer sequences
-  if( P.nbMoves()<=12 )
+  if( opening && P.nbMoves()<=12 )
     {
       if( P.nbMoves()==12 )
         {
           // find solution in dedicated (complete) 12-move opening book
-          if(int val = book12.get(P)) return val + Position::MIN_SCORE - 1;
+          if(int val = books->book12.get(P)) { score = val + Position::MIN_SCORE - 1; TRACE(TRACE_BOOK_HIT, P, alpha, beta, score); return true; }
         }
       else 
         {
           // look for solutions stored in general opening book
-          if(int val = book.get(P))  return val + Position::MIN_SCORE - 1;
+          if(int val = books->book.get(P))  { score = val + Position::MIN_SCORE - 1; TRACE(TRACE_BOOK_HIT, P, alpha, beta, score); return true; }
         }
     }
 
-  MoveSorter moves;
+  position_t candidates[Position::WIDTH];
+  int scores[Position::WIDTH];
+  int nbCandidates = 0;
   for(int i = Position::WIDTH; i--;)
-    if(Position::position_t move = possible & Position::column_mask(columnOrder[i]))
-      moves.add(move, P.moveScore(move));
+    if(position_t move = possible & Position::column_mask(columnOrder[i]))
+      candidates[nbCandidates++] = move;
+  if(useChildProbes)
+    for(int i = 0; i < nbCandidates; i++)
+      tablePrefetch(P.nbMoves() + 1, P.keyAfter(candidates[i])); // children entries are loaded while moves are scored
+  P.moveScores(candidates, nbCandidates, scores); // score all the moves in a single batch
+
+  if(useChildProbes)
+    for(int i = 0; i < nbCandidates; i++)
+      if(int val = tableGet(P.nbMoves() + 1, P.keyAfter(candidates[i]))) {
+        if(val > Position::MAX_SCORE - Position::MIN_SCORE + 1) { // lower bound of the child, upper bound of ours
+          if(-(val + 2 * Position::MIN_SCORE - Position::MAX_SCORE - 2) <= alpha) scores[i] -= Position::WIDTH * Position::HEIGHT; // cannot raise alpha: last
+        } else if(-(val + Position::MIN_SCORE - 1) >= beta) scores[i] += Position::WIDTH * Position::HEIGHT; // gives a cut: first
+      }
+
+  moves.reset();
+  for(int i = 0; i < nbCandidates; i++)
+    moves.add(candidates[i], scores[i]);
+
+  return false;
+}
+
+/**
+ * Reccursively score connect 4 position using negamax variant of alpha-beta algorithm.
+ * @param: position to evaluate, this function assumes nobody already won and
+ *         current player cannot win next move. This has to be checked before
+ * @param: alpha < beta, a score window within which we are evaluating the position.
+ *
+ * @return the exact score, an upper or lower bound score depending of the case:
+ * - if actual score of position <= alpha then actual score <= return value <= alpha
+ * - if actual score of position >= beta then beta <= return value <= actual score
+ * - if alpha <= actual score <= beta then return value = actual score
+ */
+template<int width, int height>
+int BasicSolver<width, height>::negamax(const Position &P, int alpha, int beta) {
+  int nodeScore;
+  MoveSorter moves;
+  TRACE(TRACE_ENTER, P, alpha, beta, 0);
+  if(isOpening(P) ? enterNode<true>(P, alpha, beta, nodeScore, moves) : enterNode<false>(P, alpha, beta, nodeScore, moves)) {
+    TRACE(TRACE_EXIT, P, alpha, beta, nodeScore);
+    return nodeScore;
+  }
 
-  while(Position::position_t next = moves.getNext()) {
+  const position_t key = P.key();
+  while(position_t next = moves.getNext()) {
+    TRACE_PLAY(P, next, alpha, beta);
     Position P2(P);
     P2.play(next);  // It's opponent turn in P2 position after current player plays x column.
     int score = -negamax(P2, -beta, -alpha); // explore opponent's score within [-beta;-alpha] windows:
@@ -109,44 +231,218 @@ int Solver::negamax(const Position &P, int alpha, int beta) {
     // no need to check for score worse than alpha (opponent's score worse better than -alpha)
 
     if(score >= beta) {
-      transTable.put(key, score + Position::MAX_SCORE - 2 * Position::MIN_SCORE + 2); // save the lower bound of the position
+      tablePut(P.nbMoves(), key, score + Position::MAX_SCORE - 2 * Position::MIN_SCORE + 2); // save the lower bound of the position
+      TRACE(TRACE_EXIT, P, alpha, beta, score);
       return score;  // prune the exploration if we find a possible move better than what we were looking for.
     }
     if(score > alpha) alpha = score; // reduce the [alpha;beta] window for next exploration, as we only
     // need to search for a position that is better than the best so far.
   }
 
-  transTable.put(key, alpha - Position::MIN_SCORE + 1); // save the upper bound of the position
+  tablePut(P.nbMoves(), key, alpha - Position::MIN_SCORE + 1); // save the upper bound of the position
+  TRACE(TRACE_EXIT, P, alpha, beta, alpha);
   return alpha;
 }
 
-int Solver::solve(const Position &P, bool weak) {
-  if(P.canWinNext()) // check if win in one move as the Negamax function does not support this case.
-    return (Position::WIDTH * Position::HEIGHT + 1 - P.nbMoves()) / 2;
-  int min = -(Position::WIDTH * Position::HEIGHT - P.nbMoves()) / 2;
-  int max = (Position::WIDTH * Position::HEIGHT + 1 - P.nbMoves()) / 2;
+template<int width, int height>
+bool BasicSolver<width, height>::pushFrame(const Position &P, int alpha, int beta, int &score) {
+  Frame &f = frames[nbFrames];
+  f.P = P;
+  TRACE(TRACE_ENTER, P, alpha, beta, 0);
+  if(isOpening(P) ? enterNode<true>(f.P, alpha, beta, score, f.moves) : enterNode<false>(f.P, alpha, beta, score, f.moves)) {
+    TRACE(TRACE_EXIT, P, alpha, beta, score);
+    return true;
+  }
+  f.alpha = alpha;
+  f.beta = beta;
+  nbFrames++;
+  return false;
+}
+
+/**
+ * Same exploration as negamax, the recursion being replaced by the frames stack:
+ * a frame is pushed when a child is entered and popped when its score is known,
+ * the score is then handled by its parent as in the loop of negamax.
+ */
+template<int width, int height>
+bool BasicSolver<width, height>::runFrames(unsigned long long nodeLimit, int &score) {
+  bool returning = false; // a node was just solved, score is its score
+  for(;;) {
+    if(returning) {
+      if(nbFrames == 0) return true;
+      Frame &f = frames[nbFrames - 1];
+      int s = -score;
+      if(s >= f.beta) {
+        tablePut(f.P.nbMoves(), f.P.key(), s + Position::MAX_SCORE - 2 * Position::MIN_SCORE + 2); // save the lower bound of the position
+        TRACE(TRACE_EXIT, f.P, f.alpha, f.beta, s);
+        score = s;
+        nbFrames--;
+        continue;  // prune the exploration, s is the score of the popped frame
+      }
+      if(s > f.alpha) f.alpha = s;
+      returning = false;
+    }
+
+    Frame &f = frames[nbFrames - 1];
+    if(nodeCount >= nodeLimit) return false; // suspend before entering a new node
+
+    if(position_t next = f.moves.getNext()) {
+      TRACE_PLAY(f.P, next, f.alpha, f.beta);
+      Position P2(f.P);
+      P2.play(next);
+      returning = pushFrame(P2, -f.beta, -f.alpha, score);
+    } else {
+      tablePut(f.P.nbMoves(), f.P.key(), f.alpha - Position::MIN_SCORE + 1); // save the upper bound of the position
+      TRACE(TRACE_EXIT, f.P, f.alpha, f.beta, f.alpha);
+      score = f.alpha;
+      nbFrames--;
+      returning = true;
+    }
+  }
+}
+
+template<int width, int height>
+int BasicSolver<width, height>::firstGuess(const Position &P, int guess) {
+  if(int val = tableGet(P.nbMoves(), P.key())) {
+    if(val > Position::MAX_SCORE - Position::MIN_SCORE + 1) // lower bound
+      return val + 2 * Position::MIN_SCORE - Position::MAX_SCORE - 2;
+    else // upper bound
+      return val + Position::MIN_SCORE - 1;
+  }
+  return guess == NO_GUESS ? 0 : guess;
+}
+
+template<int width, int height>
+void BasicSolver<width, height>::startRoot(const Position &P, bool weak, int guess) {
+  root.P = P;
+  root.weak = weak;
+  if(P.canWinNext()) { // check if win in one move as the Negamax function does not support this case.
+    root.min = root.max = (Position::WIDTH * Position::HEIGHT + 1 - P.nbMoves()) / 2;
+    return;
+  }
+  root.min = -(Position::WIDTH * Position::HEIGHT - P.nbMoves()) / 2;
+  root.max = (Position::WIDTH * Position::HEIGHT + 1 - P.nbMoves()) / 2;
   if(weak) {
-    min = -1;
-    max = 1;
+    root.min = -1;
+    root.max = 1;
+  }
+  if(driver == MTDF) root.med = firstGuess(P, guess);
+}
+
+template<int width, int height>
+int BasicSolver<width, height>::probeValue() {
+  if(driver == MTDF) {                 // each probe moves one end of [min,max] to the returned bound
+    if(root.med < root.min) root.med = root.min;
+    else if(root.med >= root.max) root.med = root.max - 1;
+    return root.med;
+  }
+  int med = root.min + (root.max - root.min) / 2; // iteratively narrow the min-max exploration window
+  if(med <= 0 && root.min / 2 < med) med = root.min / 2;
+  else if(med >= 0 && root.max / 2 > med) med = root.max / 2;
+  return med;
+}
+
+template<int width, int height>
+int BasicSolver<width, height>::nextProbe() {
+  probeCount++;
+  return root.probe = probeValue();
+}
+
+template<int width, int height>
+int BasicSolver<width, height>::firstProbe(const Position &P, bool weak, int guess) {
+  startRoot(P, weak, guess);
+  return probeValue();
+}
+
+template<int width, int height>
+void BasicSolver<width, height>::probeDone(int r) {
+  if(r <= root.probe) {
+    root.max = r;
+    root.med = r - 1; // MTDF fail low: next check if the score reaches the upper bound
+  } else {
+    root.min = r;
+    root.med = r;     // MTDF fail high: next check if the score exceeds the lower bound
+  }
+}
+
+template<int width, int height>
+int BasicSolver<width, height>::solve(const Position &P, bool weak, int guess) {
+  int score;
+  if(engine == ITERATIVE) {
+    startSolve(P, weak, guess);
+    resumeSolve(~0ULL, score);
+    return score;
   }
 
-  while(min < max) {                    // iteratively narrow the min-max exploration window
-    int med = min + (max - min) / 2;
-    if(med <= 0 && min / 2 < med) med = min / 2;
-    else if(med >= 0 && max / 2 > med) med = max / 2;
-    int r = negamax(P, med, med + 1);   // use a null depth window to know if the actual score is greater or smaller than med
-    if(r <= med) max = r;
-    else min = r;
+  startRoot(P, weak, guess);
+  while(root.min < root.max) {
+    int med = nextProbe();
+    probeDone(negamax(P, med, med + 1)); // use a null depth window to know if the actual score is greater or smaller than med
   }
-  return min;
+  return rootScore();
+}
+
+template<int width, int height>
+void BasicSolver<width, height>::startSolve(const Position &P, bool weak, int guess) {
+  startRoot(P, weak, guess);
+  nbFrames = 0;
+}
+
+template<int width, int height>
+bool BasicSolver<width, height>::resumeSolve(unsigned long long maxNodes, int &score) {
+  const unsigned long long nodeLimit = maxNodes > ~0ULL - nodeCount ? ~0ULL : nodeCount + maxNodes;
+  while(root.min < root.max) {
+    int r;
+    if(nbFrames == 0) {
+      if(nodeCount >= nodeLimit) return false;
+      int med = nextProbe();
+      if(pushFrame(root.P, med, med + 1, r)) {
+        probeDone(r);
+        continue;
+      }
+    }
+    if(!runFrames(nodeLimit, r)) return false;
+    probeDone(r);
+  }
+  score = rootScore();
+  return true;
+}
+
+template<int width, int height>
+int BasicSolver<width, height>::bookScore(const Position &P) const {
+  if(int val = books->get(P)) return val + Position::MIN_SCORE - 1;
+  return NO_GUESS;
 }
 
 // Constructor
-Solver::Solver() : nodeCount{0} {
+template<int width, int height>
+BasicSolver<width, height>::BasicSolver() : transTable{new Table}, ownTable{true}, books{&ownBooks}, nodeCount{0}, probeCount{0}, driver{BISECTION}, engine{RECURSIVE}, useRules{false}, useChildProbes{true}, endgameCells{ENDGAME_CELLS}, nbFrames{0} {
+  setNearPly(0);
+  resetNodeCount();
   for(int i = 0; i < Position::WIDTH; i++) // initialize the column exploration order, starting with center columns
     columnOrder[i] = Position::WIDTH / 2 + (1 - 2 * (i % 2)) * (i + 1) / 2; // example for WIDTH=7: columnOrder = {3, 4, 2, 5, 1, 6, 0}
 }
 
+template<int width, int height>
+BasicSolver<width, height>::BasicSolver(BasicSolver *shared) : transTable{shared->transTable}, ownTable{false}, nearPly{shared->nearPly},
+  books{shared->books}, nodeCount{0}, probeCount{0}, driver{shared->driver}, engine{shared->engine}, useRules{shared->useRules}, useChildProbes{shared->useChildProbes}, endgameCells{shared->endgameCells}, nbFrames{0} {
+  resetNodeCount();
+  for(int i = 0; i < Position::WIDTH; i++) columnOrder[i] = shared->columnOrder[i];
+}
+
+template<int width, int height>
+BasicSolver<width, height>::~BasicSolver() {
+  if(ownTable) delete transTable;
+}
+
+// supported board sizes
+template class BasicSolver<7, 6>;
+#ifdef _X86
+template class BasicSolver<6, 5>;
+template class BasicSolver<8, 7>;
+template class BasicSolver<9, 7>;
+#endif
+
 
 } // namespace Connect4
 } // namespace GameSolver
@@ -166,121 +462,517 @@ extern unsigned char G_BOOK12;
 extern unsigned char G_BOOK12_END;
 #endif
 
-static Solver *solver = NULL;
+#ifdef _X86
+// spin lock for state shared by the threads using solver instances
+#define LOCK(l)   while( __atomic_test_and_set(&l, __ATOMIC_ACQUIRE) )
+#define UNLOCK(l) __atomic_clear(&l, __ATOMIC_RELEASE)
+#else
+#define LOCK(l)
+#define UNLOCK(l)
+#endif
 
 
-static int getBestMove(Solver &solver, Position P, int *score = NULL)
+/**
+ * Score all columns for the player to move: 100 for an immediate win, -100 for a full column
+ * or a column not in candidates (if given). With weak=true scores of other columns are
+ * only -1, 0 or 1 (loss, draw, win), which is much faster to compute than the exact score.
+ * guess is the expected score of P (or S::NO_GUESS), used to seed the search of each column.
+ */
+template<class S>
+static void getColumnScores(S &solver, const typename S::Position &P, int *scores, bool weak, int guess, const bool *candidates = NULL)
 {
-  int scores[7], bestScore = -100, bestColumn = -1;
+  using Position = typename S::Position;
 
-  act_led(1);
-
-  solver.resetNodeCount();
-  for(int i=0; i<7; i++)
+  for(int i=0; i<Position::WIDTH; i++)
     {
       Position P2 = P;
-      if( P2.canPlay(i) ) 
+      if( P2.canPlay(i) && (candidates==NULL || candidates[i]) )
         {
           if( P2.isWinningMove(i) )
             scores[i] = 100;
           else
             {
               P2.playCol(i);
-              scores[i] = -solver.solve(P2, false);
+              scores[i] = -solver.solve(P2, weak, guess==S::NO_GUESS ? S::NO_GUESS : -guess);
             }
-
-          if( scores[i] > bestScore ) { bestScore = scores[i]; bestColumn = i; }
         }
       else
         scores[i] = -100;
     }
+}
+
+
+// randomly pick one of the best scoring columns, r being a random number
+static int pickBestColumn(const int *scores, int width, unsigned int r, int *score)
+{
+  int bestScore = -100, bestColumn = -1;
+  for(int column=0; column<width; column++)
+    if( scores[column] > bestScore ) { bestScore = scores[column]; bestColumn = column; }
 
   int numBest = 0;
-  for(int column=0; column<7; column++)
+  for(int column=0; column<width; column++)
     if( scores[column] == bestScore )
       numBest++;
   
-  numBest = ::rand() % numBest;
-  for(int column=0; column<7; column++)
+  numBest = r % numBest;
+  for(int column=0; column<width; column++)
     if( scores[column] == bestScore )
       if( numBest-- == 0 )
         bestColumn = column;
 
+  if( score!=NULL ) *score = bestScore;
+  return bestColumn;
+}
+
+
+template<class S>
+static int getBestMove(S &solver, const typename S::Position &P, int guess, unsigned int r, int *score = NULL, bool weak = false, int *columnScores = NULL)
+{
+  using Position = typename S::Position;
+  int localScores[Position::WIDTH], *scores = columnScores ? columnScores : localScores;
+
+  act_led(1);
+  solver.resetNodeCount();
+  getColumnScores(solver, P, scores, weak, guess);
+  int bestColumn = pickBestColumn(scores, Position::WIDTH, r, score);
   act_led(0);
 
-  if( score!=NULL ) *score = bestScore;
   return bestColumn;
 }
 
 
-extern "C" void solver_init()
+/**
+ * Given the column scores and best score of getBestMove with weak=true, compute exact
+ * scores for all columns keeping that outcome and pick the best of them.
+ * Entries stored in the transposition table by the weak search are reused.
+ * Other columns get -100 in columnScores (if given).
+ */
+template<class S>
+static int refineBestMove(S &solver, const typename S::Position &P, int guess, unsigned int r, const int *weakScores, int weakScore, int *score = NULL, int *columnScores = NULL)
+{
+  using Position = typename S::Position;
+  int localScores[Position::WIDTH], *scores = columnScores ? columnScores : localScores;
+  bool candidates[Position::WIDTH];
+
+  act_led(1);
+  for(int i=0; i<Position::WIDTH; i++) candidates[i] = (weakScores[i] == weakScore);
+  getColumnScores(solver, P, scores, false, guess, candidates);
+  int bestColumn = pickBestColumn(scores, Position::WIDTH, r, score);
+  act_led(0);
+
+  return bestColumn;
+}
+
+
+// opening books of the standard board, loaded once and shared by all its solvers
+static const Solver::Books *getSharedBooks()
 {
-  if( solver==NULL ) 
+  static Solver::Books *books = NULL;
+#ifdef _X86
+  static bool lock = false;
+#endif
+
+  LOCK(lock);
+  if( books==NULL )
     {
-      solver = new Solver;
+      books = new Solver::Books;
 #ifdef _X86
-      solver->getBook().loadFile("book.dat");
-      solver->getBook12().loadFile("book12.dat");
+      books->books.loadFile("books.c4b");
+      books->book.loadFile("book.dat");
+      books->book12.loadFile("book12.dat");
 #else
-      solver->getBook().loadData(&G_BOOK, &G_BOOK12-&G_BOOK);
-      solver->getBook12().setData(&G_BOOK12, &G_BOOK12_END-&G_BOOK);
+      books->book.loadData(&G_BOOK, &G_BOOK12-&G_BOOK);
+      books->book12.setData(&G_BOOK12, &G_BOOK12_END-&G_BOOK);
 #endif
     }
+  UNLOCK(lock);
+
+  return books;
 }
 
-extern "C" const char *solver_solve(const char *position, unsigned long long *nodeCount)
+
+/**
+ * Format an answer "NxMM" for playing column (0-based) with the given score.
+ * If exact is false the score only tells win/draw/loss and the distance of
+ * wins and losses is sent as "??".
+ */
+template<class Position>
+static void formatAnswer(const Position &P, int column, int score, bool exact, char *res)
 {
-  static char res[5];
+  const int size = Position::WIDTH * Position::HEIGHT;
 
-  solver_init();
-  Position P;
-  if( P.play(position) )
+  res[0] = column + '1';
+  if( P.isWinningMove(column) )
+    {
+      // will win in this move if played in column
+      memcpy(res+1, "+00", 3);
+    }
+  else if( P.nbMoves()==size-1 )
+    {
+      // ties in this move if played in column
+      memcpy(res+1, "=00", 3);
+    }
+  else if( score!=0 && !exact )
+    {
+      // will win or lose if played in column, distance not computed
+      memcpy(res+1, score>0 ? "+??" : "-??", 3);
+    }
+  else if( score>0 )
+    {
+      // can win in "n" moves if played in column
+      int n = size+1 - score*2 - P.nbMoves() - (~P.nbMoves()&1);
+      res[1] = '+';
+      res[2] = '0' + n/10;
+      res[3] = '0' + n%10;
+    }
+  else if( score<0 )
+    {
+      // will lose in no fewer than "n" moves if played in column
+      int n = size+1 + score*2 - P.nbMoves() - (P.nbMoves()&1);
+      res[1] = '-';
+      res[2] = '0' + n/10;
+      res[3] = '0' + n%10;
+    }
+  else
     {
-      int column, score;
+      // can tie in "n" moves if played in column
+      int n = size-1 - P.nbMoves();
+      res[1] = '=';
+      res[2] = '0' + n/10;
+      res[3] = '0' + n%10;
+    }
 
-      uart_write("!", 1);
-      column = getBestMove(*solver, P, &score);
+  res[4] = 0;
+}
 
-      res[0] = column + '1';
-      if( P.isWinningMove(column) )
-        {
-          // will win in this move if played in column
-          memcpy(res+1, "+00", 3);
-        }
-      else if( P.nbMoves()==41 )
-        {
-          // ties in this move if played in column
-          memcpy(res+1, "=00", 3);
-        }
-      else if( score>0 )
-        {
-          // can win in "n" moves if played in column
-          int n = 43 - score*2 - P.nbMoves() - (~P.nbMoves()&1);
-          res[1] = '+';
-          res[2] = '0' + n/10;
-          res[3] = '0' + n%10;
-        }
-      else if( score<0 )
-        {
-          // will lose in no fewer than "n" moves if played in column
-          int n = 43 + score*2 - P.nbMoves() - (P.nbMoves()&1);
-          res[1] = '-';
-          res[2] = '0' + n/10;
-          res[3] = '0' + n%10;
-        }
-      else
-        {
-          // can tie in "n" moves if played in column
-          int n = 41 - P.nbMoves();
-          res[1] = '=';
-          res[2] = '0' + n/10;
-          res[3] = '0' + n%10;
-        }
 
-      res[4] = 0;
-      if( nodeCount!=0 ) *nodeCount = solver->getNodeCount();
-      return res;
-    }
+// true if position is lastPosition followed by zero or more moves
+static bool isContinuation(const char *position, const char *lastPosition)
+{
+  int i = 0;
+  while( lastPosition[i] && lastPosition[i]==position[i] ) i++;
+  return lastPosition[i]==0;
+}
+
+
+/**
+ * Expected score for the player to move after the given moves: the exact score of the
+ * previous query if this query continues it with an even number of moves (scores do not
+ * depend on the ply so under perfect play they stay the same), NO_GUESS otherwise.
+ * The book score of an ancestor is not used: seeded with it MTDF searched more nodes than
+ * BISECTION with no guess (see connect4-bench drivers).
+ */
+template<class S>
+static int getGuess(const char *position, const char *lastPosition, int lastScore)
+{
+  int n = 0, lastN = 0;
+  while( position[n] ) n++;
+  while( lastPosition[lastN] ) lastN++;
+
+  if( lastScore!=S::NO_GUESS && ((n-lastN)&1)==0 && isContinuation(position, lastPosition) )
+    return lastScore;
+
+  return S::NO_GUESS;
+}
+
+
+// a handle of the C interface (see SolverInstance)
+struct solver_instance
+{
+  virtual const char *solve(const char *position, int flags, char *res, unsigned long long *nodeCount) { return NULL; }
+  virtual int estimate(const char *position, int flags) { return -1; }
+  virtual void cacheStats(unsigned long long *hits, unsigned long long *misses) {}
+  virtual ~solver_instance() {}
+};
+
+
+/**
+ * Solver instance of the C interface for one board size: its own transposition table and
+ * cache of answers, the previous query of the game being played (see getGuess), a random
+ * generator and the transport of the "!" acknowledgement and early answers.
+ * Instances do not share any state except the read-only opening books.
+ */
+template<class S>
+class SolverInstance : public solver_instance
+{
+  using Position = typename S::Position;
+  using ProofSolver = BasicProofSolver<Position::WIDTH, Position::HEIGHT>;
+
+  S solver;
+  ProofSolver *proof; // created by the first SOLVER_PROOF query
+#ifdef _X86
+  ParallelProbes<S> *parallel; // probes of the negamax searches in parallel threads, NULL for one thread
+#endif
+  const typename S::Books *books;
+  AnswerCache<Position> cache;
+  char lastPosition[Position::WIDTH*Position::HEIGHT+1];
+  int lastScore;
+  bool useRand;      // seed 0: use rand() as before instances
+  unsigned int seed;
+  void (*write)(void *context, const char *s, unsigned int n);
+  void *context;
+
+  unsigned int random()
+  {
+    if( useRand ) return ::rand();
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) & 0x7fff;
+  }
+
+  void send(const char *s, unsigned int n)
+  {
+    if( write!=NULL ) write(context, s, n);
+  }
+
+  // effort estimate of a query of P (see solver_estimate_r)
+  int estimate(const Position &P, int flags)
+  {
+    bool weak = (flags & (SOLVER_WDL | SOLVER_PROOF))!=0 && (flags & SOLVER_REFINE)==0; // refined answers are exact
+    if( cache.contains(P, !weak) ) return 0;
+    return EffortModel<Position>::estimate(P, books ? books->depth() : -1, weak);
+  }
+
+ public:
+  SolverInstance(const solver_config *config, const typename S::Books *books) :
+    proof{NULL}, books{books}, lastScore{S::NO_GUESS}, useRand{config->seed==0}, seed{config->seed}, write{config->write}, context{config->context}
+  {
+    lastPosition[0] = 0;
+    solver.setRules(true);
+    solver.setBooks(books);
+    solver.setNearPly(Position::WIDTH*Position::HEIGHT - 16); // near-leaf table for the last 16 plies (see connect4-bench tiers)
+#ifdef _X86
+    if( config->threads>1 && !S::SHARED_TABLE )
+      fprintf(stderr, "solver: %i threads need single-word table entries (build with -DTABLE_SHARED), using one\n", config->threads);
+    parallel = config->threads>1 && S::SHARED_TABLE ? new ParallelProbes<S>(solver, config->threads) : NULL;
+#endif
+  }
+
+  ~SolverInstance()
+  {
+    delete proof;
+#ifdef _X86
+    delete parallel;
+#endif
+  }
+
+  // nodes searched by the negamax solver (and its threads)
+  unsigned long long negamaxNodes()
+  {
+#ifdef _X86
+    if( parallel ) return parallel->getNodeCount();
+#endif
+    return solver.getNodeCount();
+  }
+
+  const char *solve(const char *position, int flags, char *res, unsigned long long *nodeCount)
+  {
+    Position P;
+    if( P.play(position) )
+      {
+        int column, score, scores[Position::WIDTH];
+        bool weak = (flags & (SOLVER_WDL | SOLVER_REFINE | SOLVER_PROOF))!=0;
+        if( proof ) proof->resetNodeCount();
+        bool exact = !weak || (flags & SOLVER_REFINE)!=0; // the final answer must be exact
+
+        if( flags & SOLVER_ESTIMATE )
+          {
+            int e = estimate(P, flags);
+            char ack[4] = { '!', 'e', char('0' + e/10), char('0' + e%10) };
+            send(ack, 4);
+          }
+        else
+          send("!", 1);
+        if( cache.get(P, scores, exact) )
+          {
+            // position (or its mirror image) answered before, no search needed
+            solver.resetNodeCount();
+#ifdef _X86
+            if( parallel ) parallel->resetNodeCount();
+#endif
+            column = pickBestColumn(scores, Position::WIDTH, random(), &score);
+            formatAnswer(P, column, score, exact, res);
+            if( flags & SOLVER_REFINE ) send(res, 4);
+          }
+        else
+          {
+            int guess = getGuess<S>(position, lastPosition, lastScore);
+            if( !isContinuation(position, lastPosition) ) solver.newGame();
+            solver.setDriver(guess!=S::NO_GUESS ? S::MTDF : S::BISECTION); // MTDF only pays off with a good guess
+
+            if( flags & SOLVER_PROOF )
+              {
+                // win/draw/loss of each column by the first of the proof-number and negamax searches
+                if( proof==NULL ) { proof = new ProofSolver; proof->setBooks(books); }
+                ProofRace<S> race(solver, *proof);
+                column = getBestMove(race, P, guess, random(), &score, weak, scores);
+              }
+#ifdef _X86
+            else if( parallel )
+              column = getBestMove(*parallel, P, guess, random(), &score, weak, scores);
+#endif
+            else
+              column = getBestMove(solver, P, guess, random(), &score, weak, scores);
+            formatAnswer(P, column, score, !weak, res);
+
+            if( flags & SOLVER_REFINE )
+              {
+                // send the win/draw/loss answer now and compute the distance afterwards
+                // (draws and immediate wins are already exact)
+                send(res, 4);
+                if( score==1 || score==-1 )
+                  {
+#ifdef _X86
+                    if( parallel )
+                      column = refineBestMove(*parallel, P, guess, random(), scores, score, &score, scores);
+                    else
+#endif
+                    column = refineBestMove(solver, P, guess, random(), scores, score, &score, scores);
+                    weak = false;
+                    formatAnswer(P, column, score, true, res);
+                  }
+              }
+
+            // a win/draw/loss answer is exact for draws and immediate wins
+            exact = !weak || score==0 || score==100;
+            cache.put(P, scores, exact);
+          }
+
+        // remember the exact score for the next query of this game
+        int i;
+        for(i=0; position[i]; i++) lastPosition[i] = position[i];
+        lastPosition[i] = 0;
+        lastScore = (!exact || score==100) ? S::NO_GUESS : score;
+
+        if( nodeCount!=0 ) *nodeCount = negamaxNodes() + (proof ? proof->getNodeCount() : 0);
+        return res;
+      }
+    else
+      return NULL;
+  }
+
+  int estimate(const char *position, int flags)
+  {
+    Position P;
+    return P.play(position) ? estimate(P, flags) : -1;
+  }
+
+  void cacheStats(unsigned long long *hits, unsigned long long *misses)
+  {
+    if( hits!=NULL )   *hits = cache.getHits();
+    if( misses!=NULL ) *misses = cache.getMisses();
+  }
+};
+
+
+extern "C" solver_t *solver_create(const solver_config *config)
+{
+  static const solver_config defaults = { 0, 0, 0, NULL, NULL, 0 };
+  if( config==NULL ) config = &defaults;
+
+  int width = config->width ? config->width : 7, height = config->height ? config->height : 6;
+  if( width==7 && height==6 )
+    return new SolverInstance<Solver>(config, getSharedBooks());
+#ifdef _X86
+  else if( width==6 && height==5 )
+    return new SolverInstance<BasicSolver<6, 5> >(config, NULL);
+  else if( width==8 && height==7 )
+    return new SolverInstance<BasicSolver<8, 7> >(config, NULL);
+  else if( width==9 && height==7 )
+    return new SolverInstance<BasicSolver<9, 7> >(config, NULL);
+#endif
   else
     return NULL;
 }
+
+
+extern "C" const char *solver_solve_r(solver_t *s, const char *position, int flags, char *result, unsigned long long *nodeCount)
+{
+  return s->solve(position, flags, result, nodeCount);
+}
+
+
+extern "C" int solver_estimate_r(solver_t *s, const char *position, int flags)
+{
+  return s->estimate(position, flags);
+}
+
+
+extern "C" void solver_cache_stats_r(solver_t *s, unsigned long long *hits, unsigned long long *misses)
+{
+  s->cacheStats(hits, misses);
+}
+
+
+extern "C" void solver_destroy(solver_t *s)
+{
+  delete s;
+}
+
+
+// ----------------------------------------- single instance interface
+
+
+static void uartTransport(void *context, const char *s, unsigned int n)
+{
+  uart_write(s, n);
+}
+
+
+// solvers of the single instance interface, created on first use for each board size
+// (only 7x6 has opening books)
+static solver_t *getDefaultSolver(int width, int height)
+{
+  static const int sizes[4][2] = { {7, 6}, {6, 5}, {8, 7}, {9, 7} };
+  static solver_t *solvers[4] = { NULL, NULL, NULL, NULL };
+
+  for(int i=0; i<4; i++)
+    if( sizes[i][0]==width && sizes[i][1]==height )
+      {
+        if( solvers[i]==NULL )
+          {
+            solver_config config = { width, height, 0, uartTransport, NULL, 0 };
+            solvers[i] = solver_create(&config);
+          }
+        return solvers[i];
+      }
+
+  return NULL;
+}
+
+
+extern "C" void solver_init()
+{
+  getDefaultSolver(7, 6);
+}
+
+
+extern "C" void solver_cache_stats(unsigned long long *hits, unsigned long long *misses)
+{
+  solver_cache_stats_r(getDefaultSolver(7, 6), hits, misses);
+}
+
+
+extern "C" int solver_estimate(const char *position, int flags)
+{
+  return solver_estimate_r(getDefaultSolver(7, 6), position, flags);
+}
+
+
+extern "C" const char *solver_solve_ex(const char *position, int flags, unsigned long long *nodeCount)
+{
+  return solver_solve_board(7, 6, position, flags, nodeCount);
+}
+
+
+extern "C" const char *solver_solve(const char *position, unsigned long long *nodeCount)
+{
+  return solver_solve_ex(position, 0, nodeCount);
+}
+
+
+extern "C" const char *solver_solve_board(int width, int height, const char *position, int flags, unsigned long long *nodeCount)
+{
+  static char res[5];
+  solver_t *s = getDefaultSolver(width, height);
+  return s ? solver_solve_r(s, position, flags, res, nodeCount) : NULL;
+}
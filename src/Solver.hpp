@@ -19,26 +19,148 @@
 #ifndef SOLVER_HPP
 #define SOLVER_HPP
 
+// flags for solver_solve_ex
+#define SOLVER_WDL    1 // only compute win/draw/loss, answer distance of wins and losses as "??"
+#define SOLVER_REFINE 2 // send the win/draw/loss answer, then compute and return the exact one
+#define SOLVER_PROOF  4 // win/draw/loss answer settled by the proof-number search raced with negamax
+#define SOLVER_ESTIMATE 8 // acknowledge with "!eNN", NN being the effort estimate (see solver_estimate_r)
+
 #ifdef __cplusplus 
 
 #include <cstddef>
 
 #include "Position.hpp"
+#include "MoveSorter.hpp"
 #include "TranspositionTable.hpp"
 #include "OpeningBook.hpp"
 #include "OpeningBook12.hpp"
+#include "BookContainer.hpp"
+#include "ThreatRules.hpp"
+#ifdef SOLVER_TRACE
+#include "SearchTrace.hpp"
+#endif
 
 namespace GameSolver {
 namespace Connect4 {
 
-class Solver {
+/**
+ * Opening books of a board size. Once loaded they are only read, so that one set of
+ * books can be shared by any number of solvers (see BasicSolver::setBooks).
+ */
+template<int width, int height>
+struct BasicBooks {
+  OpeningBook book{width, height}; // opening book
+  OpeningBook12 book12{width, height}; // complete 12-move opening book
+  BookContainer books{width, height}; // multi-depth books, looked up before book and book12
+
+  /**
+   * @return the value stored for P in one of the books (score - MIN_SCORE + 1), 0 if none.
+   */
+  template<class P>
+  int get(const P &pos) const {
+    if(int val = books.get(pos)) return val;
+    if(pos.nbMoves() == 12) return book12.get(pos);
+    return book.get(pos);
+  }
+
+  // deepest ply of the positions in the books, -1 if none is loaded
+  int depth() const {
+    int d = books.maxDepth() > book.maxDepth() ? books.maxDepth() : book.maxDepth();
+    return book12.ok() && d < 12 ? 12 : d;
+  }
+};
+
+/**
+ * Solver for a board of width x height cells.
+ * Masks, bitboard type and transposition table key width are all derived
+ * at compile time from the board size (see BasicPosition).
+ */
+template<int width, int height>
+class BasicSolver {
+ public:
+  using Position = BasicPosition<width, height>;
+  using position_t = typename Position::position_t;
+  using MoveSorter = BasicMoveSorter<Position>;
+  using Books = BasicBooks<width, height>;
+
+  // root search drivers used by solve()
+  enum Driver {
+    BISECTION, // null window probes narrowing [min,max], biased toward 0 (default)
+    MTDF       // MTD(f): first probe at the best available guess, then at each returned bound,
+               // only fewer nodes than BISECTION with the exact score as guess (see connect4-bench drivers)
+  };
+
+  // search engines used by solve()
+  enum Engine {
+    RECURSIVE, // recursive negamax
+    ITERATIVE  // same search with an explicit stack of frames, can be suspended (see startSolve)
+  };
+
+  static constexpr int NO_GUESS = 1000; // no prior knowledge of a score
+  static constexpr int ENDGAME_CELLS = 8; // default number of empty cells below which endgame() is used
+#if defined(TABLE_PACKED) || defined(TABLE_SHARED)
+  static constexpr bool SHARED_TABLE = true; // table entries are single words, threads can share them (see ParallelProbes)
+#else
+  static constexpr bool SHARED_TABLE = false;
+#endif
+
  private:
   static constexpr int TABLE_SIZE = 24; // store 2^TABLE_SIZE elements in the transpositiontbale
-  TranspositionTable < uint_t < Position::WIDTH*(Position::HEIGHT + 1) - TABLE_SIZE >, Position::position_t, uint8_t, TABLE_SIZE > transTable;
-  OpeningBook book{Position::WIDTH, Position::HEIGHT}; // opening book
-  OpeningBook12 book12{Position::WIDTH, Position::HEIGHT}; // complete 12-move opening book
+  static constexpr int VALUE_BITS = log2(2 * Position::MAX_SCORE - 2 * Position::MIN_SCORE + 2) + 1; // largest stored value is a lower bound of MAX_SCORE
+#ifdef TABLE_PACKED
+  // entries packed in single words: 25 bits of key and 7 bits of value make 32 bits on 7x6 boards,
+  // there is no room for generations (reset and newGame clear the table).
+  static constexpr int GENERATION_BITS = 0;
+  using Table = TranspositionTable < uint_t < Position::WIDTH*(Position::HEIGHT + 1) - TABLE_SIZE + VALUE_BITS >, position_t, uint8_t, TABLE_SIZE, GENERATION_BITS, VALUE_BITS >;
+#elif defined(TABLE_SHARED)
+  // entries packed in single words with their generation (39 bits on 7x6 boards, in 64-bit words):
+  // threads can share the table (see ParallelProbes)
+  static constexpr int GENERATION_BITS = 6;
+  using Table = TranspositionTable < uint_t < Position::WIDTH*(Position::HEIGHT + 1) - TABLE_SIZE + 1 + GENERATION_BITS + VALUE_BITS >, position_t, uint8_t, TABLE_SIZE, GENERATION_BITS, VALUE_BITS >;
+#else
+  static constexpr int GENERATION_BITS = 6; // generation tag in the partial keys (2-entry buckets)
+  using Table = TranspositionTable < uint_t < Position::WIDTH*(Position::HEIGHT + 1) - TABLE_SIZE + 1 + GENERATION_BITS >, position_t, uint8_t, TABLE_SIZE, GENERATION_BITS >;
+#endif
+  Table *transTable; // own table, or the table of the solver shared (see BasicSolver(BasicSolver *))
+  bool ownTable;
+  // near-leaf tier (see setNearPly): 2^NEAR_TABLE_SIZE entries replaced by every store, packed in
+  // single words when key and value fit 64 bits (128 KB on 7x6 boards, cache resident)
+  static constexpr int NEAR_TABLE_SIZE = 14;
+  static constexpr int NEAR_VALUE_BITS = Position::WIDTH*(Position::HEIGHT + 1) - NEAR_TABLE_SIZE + VALUE_BITS <= 64 ? VALUE_BITS : 0;
+  TranspositionTable < uint_t < Position::WIDTH*(Position::HEIGHT + 1) - NEAR_TABLE_SIZE + NEAR_VALUE_BITS >, position_t, uint8_t, NEAR_TABLE_SIZE, 0, NEAR_VALUE_BITS > nearTable;
+  int nearPly; // positions after nearPly moves or more use nearTable instead of transTable
+  unsigned long long tableProbes[2], tableHits[2]; // lookups of the positions entered, in transTable and nearTable
+  Books ownBooks; // books loaded with getBook(), getBook12() and getBooks()
+  const Books *books; // books looked up by the search, ownBooks unless shared (see setBooks)
   unsigned long long nodeCount; // counter of explored nodes.
+  unsigned long long probeCount; // counter of null window searches started by solve
   int columnOrder[Position::WIDTH]; // column exploration order
+  Driver driver;
+  Engine engine;
+  bool useRules; // bound scores with static threat rules (see ThreatRules)
+  bool useChildProbes; // prefetch the children entries and order moves with their bounds
+  int endgameCells; // positions with at most this number of empty cells are solved by endgame()
+
+  // state of the root driver, kept between probes (and between time slices of the iterative engine)
+  struct Root {
+    Position P;
+    int min, max; // bounds of the root score
+    int med;      // next MTDF probe
+    int probe;    // null window [probe, probe+1] being searched
+    bool weak;    // only the sign of the score is returned
+  } root;
+
+  // a node of the iterative engine: the position, its current window and its remaining moves
+  struct Frame {
+    Position P;
+    int alpha, beta;
+    MoveSorter moves;
+  };
+  Frame frames[Position::WIDTH * Position::HEIGHT + 1]; // explicit stack, one frame per ply
+  int nbFrames; // number of frames in use, 0 when no probe is in progress
+#ifdef SOLVER_TRACE
+  SearchTrace trace; // events of the search (trace mode)
+#endif
 
   /**
    * Reccursively score connect 4 position using negamax variant of alpha-beta algorithm.
@@ -53,38 +175,311 @@ class Solver {
    */
   int negamax(const Position &P, int alpha, int beta);
 
+  /**
+   * Same contract as negamax, for the last plies of the game: plain alpha-beta without
+   * transposition table, books or rules, moves adding winning cells being explored first.
+   */
+  int endgame(const Position &P, int alpha, int beta);
+
+  /**
+   * Work done when entering a node, shared by both engines: counting, bounds, transposition
+   * table, static rules, opening books and generation of the sorted moves.
+   * Specialised by ply: the books are only looked up for opening positions (see isOpening)
+   * and positions with few empty cells are handed to endgame().
+   * @return true if the score of P is known without exploring its children, it is then in score.
+   * Otherwise alpha and beta are narrowed and moves holds the moves to explore.
+   */
+  template<bool opening>
+  bool enterNode(const Position &P, int &alpha, int &beta, int &score, MoveSorter &moves);
+
+  // transposition table tier of positions after ply moves (see setNearPly)
+  int tableGet(int ply, position_t key) const {
+    return ply >= nearPly ? nearTable.get(key) : transTable->get(key);
+  }
+
+  void tablePut(int ply, position_t key, uint8_t val) {
+    if(ply >= nearPly) nearTable.put(key, val);
+    else transTable->put(key, val);
+  }
+
+  void tablePrefetch(int ply, position_t key) const {
+    if(ply >= nearPly) nearTable.prefetch(key);
+    else transTable->prefetch(key);
+  }
+
+  // true if P may be in one of the opening books
+  bool isOpening(const Position &P) const {
+    return P.nbMoves() <= 12 || P.nbMoves() <= books->books.maxDepth();
+  }
+
+  /**
+   * Push a frame for P with window [alpha;beta] on the stack of the iterative engine.
+   * @return true if the score of P is known without exploring its children (nothing pushed).
+   */
+  bool pushFrame(const Position &P, int alpha, int beta, int &score);
+
+  /**
+   * Run the iterative engine on the frames of the stack until the bottom frame is
+   * solved or the node count reaches nodeLimit.
+   * @return true if the bottom frame is solved, its score is then in score.
+   */
+  bool runFrames(unsigned long long nodeLimit, int &score);
+
+  // root driver (see Driver): initial bounds, next null window and update after a probe
+  void startRoot(const Position &P, bool weak, int guess);
+  int probeValue(); // next probe of the driver (clamps med into [min,max[)
+  int nextProbe();
+  void probeDone(int r);
+
+  // score of the root once min == max: its sign for a weak search, as the bound reached
+  // by the last probe may be beyond -1 or 1
+  int rootScore() const {
+    return root.weak ? (root.min > 0) - (root.min < 0) : root.min;
+  }
+
+  /**
+   * First null window probe of the MTDF driver: the bound stored in the transposition
+   * table for P if any, else the given guess, else 0.
+   */
+  int firstGuess(const Position &P, int guess);
+
  public:
 
-  int solve(const Position &P, bool weak = false);
+  /**
+   * Score a position (see negamax for the assumptions).
+   * @param weak: only compute the sign of the score (-1, 0 or 1)
+   * @param guess: expected score of P (e.g. the score of a previous query of the same game),
+   *        used to seed the MTDF driver. Ignored by BISECTION.
+   */
+  int solve(const Position &P, bool weak = false, int guess = NO_GUESS);
+
+  /**
+   * First null window probe solve() would search for P with the same parameters, without
+   * searching (see Driver): drivers of their own start there (see ParallelProbes).
+   */
+  int firstProbe(const Position &P, bool weak = false, int guess = NO_GUESS);
+
+  /**
+   * Start solving P with the iterative engine, without exploring any node yet.
+   * Same parameters as solve(), call resumeSolve() to do the search.
+   */
+  void startSolve(const Position &P, bool weak = false, int guess = NO_GUESS);
+
+  /**
+   * Continue the search started by startSolve() for about maxNodes nodes
+   * (each slice stops before entering a new node).
+   * @return true when the search is done, the score is then in score.
+   */
+  bool resumeSolve(unsigned long long maxNodes, int &score);
+
+  /**
+   * @return the score of P if it is in one of the opening books, NO_GUESS otherwise.
+   */
+  int bookScore(const Position &P) const;
+
+  void setDriver(Driver d) {
+    driver = d;
+  }
+
+  void setEngine(Engine e) {
+    engine = e;
+  }
+
+  /**
+   * Enable or disable the static threat rules in negamax (disabled by default).
+   * The rules prove upper bounds without search, at a cost on every node with an even
+   * number of empty cells.
+   */
+  void setRules(bool on) {
+    useRules = on;
+  }
+
+  /**
+   * Enable or disable the probe of the children in the transposition table (enabled by default).
+   * Their entries are prefetched while the moves are scored, then children whose upper bound
+   * already gives a cut are explored first and children that cannot raise alpha last.
+   */
+  void setChildProbes(bool on) {
+    useChildProbes = on;
+  }
+
+  /**
+   * Positions with at most cells empty cells are solved without the transposition table
+   * (ENDGAME_CELLS by default, 0 to disable). Near the end of the game probing and
+   * storing entries costs more than the nodes it saves.
+   */
+  void setEndgameCells(int cells) {
+    endgameCells = cells;
+  }
+
+  /**
+   * Store the entries of positions after ply moves or more in a small table of their own,
+   * replaced by every store, instead of the main table (0 to disable, the default).
+   * Deep nodes are cheap to search again: this keeps them from replacing the valuable
+   * entries of shallow nodes, and their lookups hit a table that stays in the cache.
+   */
+  void setNearPly(int ply) {
+    nearPly = ply > 0 ? ply : Position::WIDTH * Position::HEIGHT + 1;
+  }
 
   void resetNodeCount() {
     nodeCount = 0;
+    probeCount = 0;
+    tableProbes[0] = tableProbes[1] = tableHits[0] = tableHits[1] = 0;
   }
 
   unsigned long long getNodeCount() const {
     return nodeCount;
   }
 
+  unsigned long long getProbeCount() const {
+    return probeCount;
+  }
+
+  // lookups of the positions entered in the main table (near = false) or the near-leaf one, and their hits
+  void getTableStats(bool near, unsigned long long &probes, unsigned long long &hits) const {
+    probes = tableProbes[near];
+    hits = tableHits[near];
+  }
+
   void reset() {
     resetNodeCount();
-    transTable.reset();
+    transTable->reset();
+    nearTable.reset();
   }
 
-  OpeningBook &getBook() { return book; }
-  OpeningBook12 &getBook12() { return book12; }
+  /**
+   * Start a new game: the transposition table keeps the entries of previous games
+   * but replaces them first.
+   */
+  void newGame() {
+    transTable->nextGeneration();
+    nearTable.nextGeneration();
+  }
+
+#ifdef SOLVER_TRACE
+  SearchTrace &getTrace() { return trace; }
+#endif
+
+  OpeningBook &getBook() { return ownBooks.book; }
+  OpeningBook12 &getBook12() { return ownBooks.book12; }
+  BookContainer &getBooks() { return ownBooks.books; }
 
-  Solver(); // Constructor
+  /**
+   * Look up shared books instead of the own ones (NULL: back to the own books).
+   * They must stay valid and unchanged while the solver uses them.
+   */
+  void setBooks(const Books *shared) {
+    books = shared ? shared : &ownBooks;
+  }
+
+  /**
+   * Start a single null window search [probe;probe+1] of P with the iterative engine,
+   * for drivers outside solve() (see ParallelProbes).
+   * @return true if the score of P is known without exploring its children, r is then the
+   *         result of the search: an upper bound of the score if r <= probe, else a lower bound.
+   */
+  bool startProbe(const Position &P, int probe, int &r) {
+    nbFrames = 0;
+    return pushFrame(P, probe, probe + 1, r);
+  }
+
+  /**
+   * Continue the search started by startProbe() for about maxNodes nodes.
+   * @return true when the search is done, its result is then in r.
+   */
+  bool resumeProbe(unsigned long long maxNodes, int &r) {
+    return runFrames(maxNodes > ~0ULL - nodeCount ? ~0ULL : nodeCount + maxNodes, r);
+  }
+
+  BasicSolver(); // Constructor
+
+  /**
+   * Solver searching the transposition table and the books of shared, which must outlive it,
+   * with the settings shared has at that time. Each has its own node count and near-leaf
+   * table. Solvers sharing a table may search in parallel threads if SHARED_TABLE is true.
+   */
+  explicit BasicSolver(BasicSolver *shared);
+  BasicSolver(const BasicSolver &) = delete;
+  BasicSolver &operator=(const BasicSolver &) = delete;
+  ~BasicSolver();
 };
 
+// solver for the standard 7x6 board
+using Solver = BasicSolver<7, 6>;
+
 } // namespace Connect4
 } // namespace GameSolver
 
 
-#else
+#endif // __cplusplus
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ------------------------------- reentrant interface
+
+// a solver for one board size, playing one game at a time (see solver_create)
+typedef struct solver_instance solver_t;
+
+typedef struct {
+  int width, height;  // board size, 0 for the standard 7x6 board
+  unsigned int seed;  // seed of the random choice among equally good columns, 0 to use rand()
+  // transport of the "!" sent when a query is accepted and of the early SOLVER_REFINE
+  // answer, NULL to send nothing
+  void (*write)(void *context, const char *s, unsigned int n);
+  void *context;      // passed to write
+  int threads;        // x86: threads running the probes of a search (see ParallelProbes), 0 or 1 for one.
+                      // Needs a -DTABLE_SHARED build, else a warning is printed and one is used
+} solver_config;
+
+// create a solver with its own transposition table, answer cache and game state.
+// 7x6 solvers share the opening books (loaded by the first one), so instances can be
+// used in parallel by different threads (one thread per instance at a time).
+// config may be NULL for defaults. Returns NULL for an unsupported board size.
+solver_t *solver_create(const solver_config *config);
+
+// same as solver_solve_board with the given solver, the answer is written to result
+// (5 chars) which is returned, NULL for an invalid position.
+const char *solver_solve_r(solver_t *s, const char *position, int flags, char *result, unsigned long long *nodeCount);
+
+// estimated log2 of the number of nodes a query of the position with the given flags would
+// search (0 to 63, 0 if answered by the books or the cache of answers), -1 for an invalid
+// position. Computed from cheap features of the position without any search (see EffortModel).
+// With SOLVER_ESTIMATE queries send it in their acknowledgement, as two decimal digits.
+int solver_estimate_r(solver_t *s, const char *position, int flags);
+
+// number of queries of a solver answered from its cache of previous answers (hits) or searched (misses).
+void solver_cache_stats_r(solver_t *s, unsigned long long *hits, unsigned long long *misses);
+
+void solver_destroy(solver_t *s);
+
+// ------------------------------- single instance interface
+// one solver per board size, "!" and early answers are sent with uart_write
 
 void solver_init();
 const char *solver_solve(const char *position, unsigned long long *nodeCount);
 
+// same as solver_solve with SOLVER_* flags.
+// With SOLVER_REFINE the win/draw/loss answer is written to the UART right after the "!"
+// and the returned answer is the exact one (possibly for another column with the same outcome).
+const char *solver_solve_ex(const char *position, int flags, unsigned long long *nodeCount);
+
+// same as solver_solve_ex for a board of width x height cells.
+// The ARM build only supports 7x6, x86 builds also support 6x5, 8x7 and 9x7.
+// Returns NULL for an invalid position or an unsupported board size.
+const char *solver_solve_board(int width, int height, const char *position, int flags, unsigned long long *nodeCount);
+
+// same as solver_estimate_r with the 7x6 solver
+int solver_estimate(const char *position, int flags);
+
+// number of 7x6 queries answered from the cache of previous answers (hits) or searched (misses).
+void solver_cache_stats(unsigned long long *hits, unsigned long long *misses);
+
+#ifdef __cplusplus
+}
 #endif
 
 
@@ -0,0 +1,459 @@
+// -----------------------------------------------------------------------------
+// Connect 4 solver on bare metal Raspberry Pi Zero
+// Copyright (C) 2019 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+// Coordinator splitting the search of a 7x6 position across local worker processes, x86 only.
+// usage: connect4-split [-j workers] [-d depth] [-v] moves
+//
+// The position is expanded to the positions depth plies below it: its columns with depth 1,
+// deeper frontier positions when there are more workers than columns. Each frontier
+// position is a job searched by a worker process with its own solver, the scores of the
+// jobs are combined by negamax in the coordinator.
+//
+// Workers are forked and talk to the coordinator with text lines on a Unix socket pair
+// (any stream would do, so a worker could as well run on another host):
+//   coordinator -> worker  "job ID ALPHA BETA MOVES"     score of MOVES in window ]ALPHA;BETA[
+//                          "window ID ALPHA BETA"        new window of job ID, empty if cancelled
+//   worker -> coordinator  "result ID SCORE BOUND NODES" BOUND: = exact score, < upper bound,
+//                                                        > lower bound (fail soft)
+// Each score raising the alpha of a position narrows the windows of the jobs below it, the
+// workers check for new windows between slices of their search.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "Solver.hpp"
+#include "workers.h"
+
+using namespace GameSolver::Connect4;
+using Position = Solver::Position;
+
+// the solver expects these from the board support code (see main.c)
+extern "C" void act_led(int on) {}
+extern "C" void uart_write(const char *s, unsigned int n) {}
+
+#define MAX_WORKERS 64     // see workers_poll
+#define MAX_DEPTH   4
+#define MAX_NODES   2801   // 1 + 7 + 7^2 + 7^3 + 7^4
+#define SLICE       65536  // nodes searched by a worker between checks for new windows
+
+static int verbose = 0;
+
+
+static bool streq(const char *a, const char *b)
+{
+  while( *a && *a==*b ) { a++; b++; }
+  return *a==*b;
+}
+
+
+static double timeInSeconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+// buffered reader of the lines of a socket
+struct LineReader {
+  int fd;
+  char buffer[1024];
+  int n;
+
+  // next line without its '\n', waiting for it if wait is set.
+  // returns 1 for a line, 0 if none is available yet, -1 at the end of the stream
+  int readLine(char *line, int size, bool wait)
+  {
+    for(;;)
+      {
+        for(int i = 0; i < n; i++)
+          if( buffer[i]=='\n' )
+            {
+              int len = i<size ? i : size - 1;
+              memcpy(line, buffer, len);
+              line[len] = 0;
+              n -= i + 1;
+              for(int j = 0; j < n; j++) buffer[j] = buffer[i + 1 + j];
+              return 1;
+            }
+        if( n==(int) sizeof(buffer) ) n = 0; // line too long, dropped
+
+        int k = workers_read(fd, buffer + n, sizeof(buffer) - n, wait);
+        if( k<=0 ) return k;
+        n += k;
+      }
+  }
+};
+
+
+// ------------------------------------------------------------------------------- worker
+
+
+// read the new windows of job id sent so far, false if the coordinator is gone
+static bool readWindow(LineReader &in, int id, int &alpha, int &beta)
+{
+  char line[128];
+  int r, i, a, b;
+  while( (r = in.readLine(line, sizeof(line), false))>0 )
+    if( sscanf(line, "window %i %i %i", &i, &a, &b)==3 && i==id ) { alpha = a; beta = b; }
+  return r==0;
+}
+
+
+// fail soft score of P in window ]alpha;beta[ by null window probes as Solver::solve does,
+// the window being updated between slices: the score is exact if bound is '=', an upper
+// bound if '<' and a lower bound if '>'. Returns false if the coordinator is gone.
+static bool search(Solver &solver, LineReader &in, int id, const Position &P, int alpha, int beta, int &score, char &bound)
+{
+  int lo, hi, med = 0; // bounds of the score, next probe
+  if( P.canWinNext() ) // not supported by the solver
+    lo = hi = (Position::WIDTH*Position::HEIGHT + 1 - P.nbMoves()) / 2;
+  else
+    {
+      lo = -(Position::WIDTH*Position::HEIGHT - P.nbMoves()) / 2;
+      hi = (Position::WIDTH*Position::HEIGHT + 1 - P.nbMoves()) / 2;
+    }
+
+  for(;;)
+    {
+      // probes telling apart the scores of ]alpha;beta[ still possible
+      int min = lo>alpha ? lo : alpha, max = (hi<beta ? hi : beta) - 1;
+      if( min>max ) break;
+
+      int p = med<min ? min : med>max ? max : med, r;
+      bool done = solver.startProbe(P, p, r);
+      while( !done )
+        {
+          done = solver.resumeProbe(SLICE, r);
+          if( !readWindow(in, id, alpha, beta) ) return false;
+          if( !done && (p<alpha || p>=beta) ) break; // the probe can not change the answer any more
+        }
+      if( !done ) continue;
+
+      if( r<=p ) { hi = r; med = r - 1; }
+      else       { lo = r; med = r; }
+    }
+
+  if( lo==hi )        { score = lo; bound = '='; }
+  else if( lo>=beta ) { score = lo; bound = '>'; }
+  else                { score = hi; bound = '<'; }
+  return true;
+}
+
+
+static int worker(int fd)
+{
+  Solver *solver = new Solver;
+  solver->getBooks().loadFile("books.c4b");
+  solver->getBook().loadFile("book.dat");
+  solver->getBook12().loadFile("book12.dat");
+  solver->setRules(true);
+  solver->setNearPly(Position::WIDTH*Position::HEIGHT - 16);
+
+  LineReader in = { fd, {0}, 0 };
+  char line[128], moves[64], answer[128];
+  int id, alpha, beta, score;
+  char bound;
+  while( in.readLine(line, sizeof(line), true)>0 )
+    {
+      Position P;
+      if( sscanf(line, "job %i %i %i %63s", &id, &alpha, &beta, moves)!=4 || !P.play(moves) ) continue;
+
+      solver->resetNodeCount();
+      if( !search(*solver, in, id, P, alpha, beta, score, bound) ) break;
+      int len = sprintf(answer, "result %i %i %c %llu\n", id, score, bound, solver->getNodeCount());
+      workers_write(fd, answer, len);
+    }
+
+  delete solver;
+  return 0;
+}
+
+
+// ------------------------------------------------------------------------------- coordinator
+
+
+// a position of the tree searched by the coordinator, the frontier positions being jobs
+struct Node {
+  Position P;
+  char moves[64];
+  int column;       // column played from the parent
+  int parent;       // -1 for the root
+  int first, count; // children: nodes first to first+count-1, none for a job
+  int best;         // best score of the children so far, from the side of the node
+  int pending;      // children not done yet
+  bool done;
+  int score;        // once done, with its bound as in search()
+  char bound;
+  int worker;       // job searched by this worker, -1 if not started
+};
+
+static Node nodes[MAX_NODES];
+static int nbNodes;
+static int rootAlpha, rootBeta;
+
+
+static bool expandable(const Position &P)
+{
+  return !P.canWinNext() && P.nbMoves()<Position::WIDTH*Position::HEIGHT;
+}
+
+
+// build the tree depth plies below node n, returns the number of jobs
+static int expand(int n, int depth)
+{
+  static const int order[7] = { 3, 4, 2, 5, 1, 6, 0 }; // center columns first, as the solver
+  Node &node = nodes[n];
+  node.first = nbNodes;
+  node.count = 0;
+  node.best = -1000;
+  node.done = false;
+  node.worker = -1;
+  if( depth==0 || !expandable(node.P) ) return 1;
+
+  for(int i = 0; i < Position::WIDTH; i++)
+    if( node.P.canPlay(order[i]) )
+      {
+        Node &child = nodes[nbNodes++];
+        child.P = node.P;
+        child.P.playCol(order[i]);
+        sprintf(child.moves, "%s%i", node.moves, order[i] + 1);
+        child.column = order[i];
+        child.parent = n;
+        node.count++;
+      }
+  node.pending = node.count;
+
+  int jobs = 0;
+  for(int i = 0; i < node.count; i++) jobs += expand(node.first + i, depth - 1);
+  return jobs;
+}
+
+
+// current window of node n: ]-beta;-alpha[ of its parent, alpha being raised by the best child
+static void window(int n, int &alpha, int &beta)
+{
+  if( nodes[n].parent<0 ) { alpha = rootAlpha; beta = rootBeta; return; }
+
+  const Node &p = nodes[nodes[n].parent];
+  int a, b;
+  window(nodes[n].parent, a, b);
+  alpha = -b;
+  beta = -(p.best>a ? p.best : a);
+}
+
+
+// true if an ancestor of node n is done: its score is not needed any more
+static bool obsolete(int n)
+{
+  for(int m = nodes[n].parent; m>=0; m = nodes[m].parent)
+    if( nodes[m].done ) return true;
+  return false;
+}
+
+
+// node n is done, combine its score with its siblings up the tree
+static void finish(int n, int score, char bound)
+{
+  for(;;)
+    {
+      Node &node = nodes[n];
+      node.done = true;
+      node.score = score;
+      node.bound = bound;
+      if( node.parent<0 || nodes[node.parent].done ) return;
+
+      Node &p = nodes[node.parent];
+      int a, b;
+      window(node.parent, a, b);
+      if( -score>p.best ) p.best = -score;
+      if( --p.pending>0 && p.best<b ) return; // wait for the other children unless cut off
+
+      n = node.parent;
+      score = p.best;
+      bound = p.best>=b ? '>' : p.best<=a ? '<' : '=';
+    }
+}
+
+
+struct Worker {
+  int pid;
+  int fd;
+  LineReader in;
+  int job;          // node searched, -1 if idle
+  int alpha, beta;  // window last sent
+};
+
+
+static int coordinator(const char *moves, int nbWorkers, int depth)
+{
+  Position P;
+  if( !P.play(moves) ) { printf("invalid position %s\n", moves); return 1; }
+  if( P.nbMoves()==Position::WIDTH*Position::HEIGHT ) { printf("%s: board full\n", moves); return 1; }
+  if( P.canWinNext() ) // nothing to split
+    {
+      int column = 0;
+      while( !P.canPlay(column) || !P.isWinningMove(column) ) column++;
+      printf("%s: score %i\nbest column %i, won in one move\n", moves, (Position::WIDTH*Position::HEIGHT + 1 - P.nbMoves()) / 2, column + 1);
+      return 0;
+    }
+
+  // smallest depth giving a job to each worker
+  nodes[0].P = P;
+  sprintf(nodes[0].moves, "%s", moves);
+  nodes[0].parent = -1;
+  int jobs = 0;
+  for(int d = depth ? depth : 1; d <= MAX_DEPTH; d++)
+    {
+      nbNodes = 1;
+      jobs = expand(0, d);
+      if( depth || jobs>=nbWorkers || d==MAX_DEPTH ) { depth = d; break; } // else fewer jobs than workers at any depth
+    }
+  rootAlpha = -(Position::WIDTH*Position::HEIGHT - P.nbMoves()) / 2 - 1; // full window: exact root score
+  rootBeta = (Position::WIDTH*Position::HEIGHT + 1 - P.nbMoves()) / 2 + 1;
+
+  static Worker workers[MAX_WORKERS];
+  int fds[MAX_WORKERS], ready[MAX_WORKERS];
+  fflush(stdout);
+  for(int w = 0; w < nbWorkers; w++)
+    {
+      Worker &wk = workers[w];
+      wk.fd = fds[w] = workers_start(worker, &wk.pid);
+      if( wk.fd<0 ) { printf("can't start worker %i\n", w); return 1; }
+      wk.in = { wk.fd, {0}, 0 };
+      wk.job = -1;
+    }
+
+  double t = timeInSeconds();
+  unsigned long long totalNodes = 0;
+  int next = 1; // jobs are started in the order of the tree
+  char line[128];
+
+  while( !nodes[0].done )
+    {
+      for(int w = 0; w < nbWorkers; w++)
+        {
+          Worker &wk = workers[w];
+          while( wk.job<0 && next<nbNodes )
+            {
+              int n = next++;
+              if( nodes[n].count>0 || obsolete(n) ) continue;
+              window(n, wk.alpha, wk.beta);
+              int len = sprintf(line, "job %i %i %i %s\n", n, wk.alpha, wk.beta, nodes[n].moves);
+              workers_write(wk.fd, line, len);
+              wk.job = n;
+              nodes[n].worker = w;
+              if( verbose ) fprintf(stderr, "worker %i: %s", w, line);
+            }
+        }
+
+      if( workers_poll(fds, nbWorkers, ready)<0 ) { printf("can't wait for the workers\n"); return 1; }
+
+      for(int w = 0; w < nbWorkers; w++)
+        {
+          Worker &wk = workers[w];
+          if( !ready[w] ) continue;
+
+          int r, id, score;
+          char bound;
+          unsigned long long n;
+          while( (r = wk.in.readLine(line, sizeof(line), false))>0 )
+            if( sscanf(line, "result %i %i %c %llu", &id, &score, &bound, &n)==4 && id==wk.job )
+              {
+                if( verbose ) fprintf(stderr, "worker %i: %s\n", w, line);
+                totalNodes += n;
+                wk.job = -1;
+                if( !obsolete(id) ) finish(id, score, bound);
+              }
+          if( r<0 ) { printf("worker %i is gone\n", w); return 1; }
+        }
+
+      // new windows of the jobs in progress, empty for the jobs no longer needed
+      for(int w = 0; w < nbWorkers; w++)
+        {
+          Worker &wk = workers[w];
+          if( wk.job<0 ) continue;
+          int alpha = 0, beta = 0;
+          if( !obsolete(wk.job) ) window(wk.job, alpha, beta);
+          if( alpha!=wk.alpha || beta!=wk.beta )
+            {
+              wk.alpha = alpha;
+              wk.beta = beta;
+              int len = sprintf(line, "window %i %i %i\n", wk.job, alpha, beta);
+              workers_write(wk.fd, line, len);
+              if( verbose ) fprintf(stderr, "worker %i: %s", w, line);
+            }
+        }
+    }
+  t = timeInSeconds() - t;
+
+  // the workers exit at the end of their stream
+  for(int w = 0; w < nbWorkers; w++) workers_stop(workers[w].fd, workers[w].pid);
+
+  const Node &root = nodes[0];
+  int bestColumn = -1;
+  printf("%s: score %i\n", moves, root.score);
+  for(int i = 0; i < root.count; i++)
+    {
+      const Node &c = nodes[root.first + i];
+      if( !c.done ) { printf("  column %i: not needed\n", c.column + 1); continue; }
+      const char *bound = c.bound=='=' ? "" : c.bound=='<' ? ">= " : "<= "; // bounds of -score
+      printf("  column %i: %s%i\n", c.column + 1, bound, -c.score);
+      if( bestColumn<0 && -c.score==root.score && c.bound!='>' ) bestColumn = c.column;
+    }
+  printf("best column %i, %i workers, depth %i, %i jobs, %llu nodes, %.3f s\n",
+         bestColumn + 1, nbWorkers, depth, jobs, totalNodes, t);
+  return 0;
+}
+
+
+static void usage()
+{
+  printf("usage: connect4-split [-j workers] [-d depth] [-v] moves\n"
+         "  -j workers  number of worker processes (default: number of processors)\n"
+         "  -d depth    plies from the position to the positions searched by the workers, 1 to %i\n"
+         "              (default: the smallest depth with a position for each worker)\n"
+         "  -v          log the messages to the workers to stderr\n"
+         "  moves       position to solve (columns 1-7), the score of each column is printed\n", MAX_DEPTH);
+}
+
+
+int main(int argc, char **argv)
+{
+  int workers = workers_processors(), depth = 0;
+  const char *moves = NULL;
+
+  for(int i = 1; i < argc; i++)
+    {
+      if( streq(argv[i], "-j") && i+1<argc )
+        workers = atoi(argv[++i]);
+      else if( streq(argv[i], "-d") && i+1<argc )
+        depth = atoi(argv[++i]);
+      else if( streq(argv[i], "-v") )
+        verbose = 1;
+      else if( moves==NULL )
+        moves = argv[i];
+      else
+        { usage(); return 1; }
+    }
+
+  if( moves==NULL || workers<1 || workers>MAX_WORKERS || depth<0 || depth>MAX_DEPTH ) { usage(); return 1; }
+  return coordinator(moves, workers, depth);
+}
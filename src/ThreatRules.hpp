@@ -0,0 +1,116 @@
+/*
+ * This file is part of Connect4 Game Solver <http://connect4.gamesolver.org>
+ * Copyright (C) 2017-2019 Pascal Pons <contact@gamesolver.org>
+ *
+ * Connect4 Game Solver is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Connect4 Game Solver is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with Connect4 Game Solver. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef THREAT_RULES_HPP
+#define THREAT_RULES_HPP
+
+#include "Position.hpp"
+
+namespace GameSolver {
+namespace Connect4 {
+
+/**
+ * Static rules proving score bounds without search, after the rules of
+ * L. V. Allis' VICTOR program ("A Knowledge-based Approach of Connect-Four", 1988).
+ *
+ * The rules implemented here are strategies of the player NOT to move (the "follower")
+ * that prevent any alignment of the player to move, proving that its score is <= 0:
+ *
+ * - claimeven: in a column with an even number of empty cells, the follower always
+ *   answers directly on top of the other player. The player to move then only gets the
+ *   empty cells of rows with the same parity as HEIGHT (rows 1, 3, 5 on a 7x6 board,
+ *   counting from 1), and vertical groups reduce to the stones already played.
+ * - baseinverse: columns with an odd number of empty cells are paired; when the player to
+ *   move plays the playable cell of one column of a pair, the follower plays the playable
+ *   cell of the other one. Both columns then have an even number of empty cells and
+ *   claimeven continues above. The player to move gets exactly one of the two cells.
+ *
+ * If no group of four can be made of stones of the player to move and of cells the
+ * strategy leaves to it, whichever cell of each pair it picks, it can at best draw.
+ * This needs an even number of empty cells (the follower never moves first).
+ */
+template<class P>
+class ThreatRules {
+  using position_t = typename P::position_t;
+  static constexpr int WIDTH = P::WIDTH;
+  static constexpr int HEIGHT = P::HEIGHT;
+
+  // mask of all cells in rows of the same parity as HEIGHT (0-based), starting at row
+  static constexpr position_t parity_rows(int row = 0) {
+    return row >= HEIGHT ? 0 : ((row % 2 == HEIGHT % 2) ? P::bottom_mask << row : 0) | parity_rows(row + 1);
+  }
+
+  /**
+   * @return true if the bitmap contains 4 aligned cells.
+   * Only cells of the board may be set (the extra top row of each column separates columns).
+   */
+  static bool hasAlignment(position_t pos) {
+    // horizontal
+    position_t m = pos & (pos >> (HEIGHT + 1));
+    if(m & (m >> (2 * (HEIGHT + 1)))) return true;
+
+    // diagonal 1
+    m = pos & (pos >> HEIGHT);
+    if(m & (m >> (2 * HEIGHT))) return true;
+
+    // diagonal 2
+    m = pos & (pos >> (HEIGHT + 2));
+    if(m & (m >> (2 * (HEIGHT + 2)))) return true;
+
+    // vertical;
+    m = pos & (pos >> 1);
+    if(m & (m >> 2)) return true;
+
+    return false;
+  }
+
+ public:
+  /**
+   * @return true if claimeven and baseinverse prove that the player to move
+   * cannot win, i.e. the score of the position is <= 0.
+   * The position must not have an immediate win for the player to move.
+   */
+  static bool cannotWin(const P &pos) {
+    if((WIDTH * HEIGHT - pos.nbMoves()) & 1) return false; // the follower must not be the one to move
+
+    const position_t claimed = pos.current_position | (~pos.mask & P::board_mask & parity_rows());
+    position_t odd = pos.possible() & ~parity_rows(); // playable cells of columns with an odd number of empty cells
+    if(!hasAlignment(claimed | odd)) return true;   // no alignment even with all of them
+
+    // baseinverse pairs: columns with odd empty cells, paired from left to right
+    position_t first[WIDTH / 2], second[WIDTH / 2];
+    int pairs = 0;
+    while(odd) {
+      first[pairs] = odd & (~odd + 1);
+      odd ^= first[pairs];
+      second[pairs] = odd & (~odd + 1);
+      odd ^= second[pairs++];
+    }
+
+    for(unsigned int choice = 0; choice < (1u << pairs); choice++) { // the player to move gets one cell of each pair
+      position_t pos2 = claimed;
+      for(int i = 0; i < pairs; i++) pos2 |= ((choice >> i) & 1) ? second[i] : first[i];
+      if(hasAlignment(pos2)) return false;
+    }
+    return true;
+  }
+};
+
+} // namespace Connect4
+} // namespace GameSolver
+#endif
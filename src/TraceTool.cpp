@@ -0,0 +1,282 @@
+// -----------------------------------------------------------------------------
+// Connect 4 solver on bare metal Raspberry Pi Zero
+// Copyright (C) 2019 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+// Converter of the search traces of the solver trace mode (see SearchTrace.hpp) to
+// flame graph input and per-ply summaries, x86 only.
+// usage: connect4-trace flame|plies TRACE ...
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SearchTrace.hpp"
+
+using namespace GameSolver::Connect4;
+
+#define MAX_PLY 64
+
+
+static bool streq(const char *a, const char *b)
+{
+  while( *a && *a==*b ) { a++; b++; }
+  return *a==*b;
+}
+
+
+// sequential reader of the events of a trace file
+struct TraceReader {
+  FILE *f;
+  int width, height;
+  TraceEvent buffer[4096];
+  size_t n, i;
+
+  bool open(const char *filename)
+  {
+    unsigned char header[16];
+    f = fopen(filename, "rb");
+    if( f==NULL ) { printf("can not read %s\n", filename); return false; }
+    if( fread(header, 1, 16, f)!=16 || memcmp(header, "C4TR", 4)!=0 || header[4]!=TRACE_VERSION )
+      {
+        printf("%s is not a trace file (version %i)\n", filename, TRACE_VERSION);
+        fclose(f);
+        return false;
+      }
+    width = header[5];
+    height = header[6];
+    n = i = 0;
+    return true;
+  }
+
+  const TraceEvent *next()
+  {
+    if( i==n )
+      {
+        n = fread(buffer, sizeof(TraceEvent), 4096, f);
+        i = 0;
+        if( n==0 ) return NULL;
+      }
+    return &buffer[i++];
+  }
+
+  ~TraceReader() { if( f ) fclose(f); }
+};
+
+
+// ------------------------------------------------------------------------------- flame graph
+
+
+// node counts of the folded stacks, open addressing hash table
+struct StackCounts {
+  char **keys;
+  unsigned long long *counts;
+  size_t size, used;
+
+  StackCounts() : keys{new char*[1024]()}, counts{new unsigned long long[1024]}, size{1024}, used{0} {}
+
+  static size_t hash(const char *s)
+  {
+    size_t h = 2166136261u;
+    while( *s ) h = (h ^ (unsigned char)*s++) * 16777619u;
+    return h;
+  }
+
+  void grow()
+  {
+    char **oldKeys = keys;
+    unsigned long long *oldCounts = counts;
+    size_t oldSize = size;
+    size *= 2;
+    keys = new char*[size]();
+    counts = new unsigned long long[size];
+    for(size_t i = 0; i < oldSize; i++)
+      if( oldKeys[i] )
+        {
+          size_t j = hash(oldKeys[i]) & (size - 1);
+          while( keys[j] ) j = (j + 1) & (size - 1);
+          keys[j] = oldKeys[i];
+          counts[j] = oldCounts[i];
+        }
+    delete[] oldKeys;
+    delete[] oldCounts;
+  }
+
+  void add(const char *stack, unsigned long long n)
+  {
+    if( (used + 1) * 10 > size * 7 ) grow(); // keep the table at most 70% full
+
+    size_t j = hash(stack) & (size - 1);
+    while( keys[j] && !streq(keys[j], stack) ) j = (j + 1) & (size - 1);
+    if( keys[j]==NULL )
+      {
+        keys[j] = new char[strlen(stack) + 1];
+        strcpy(keys[j], stack);
+        counts[j] = 0;
+        used++;
+      }
+    counts[j] += n;
+  }
+};
+
+
+// folded stacks ("frame;frame;... nodes" lines, the input of flamegraph.pl): the root of each
+// null window search is "probe[alpha;beta]", the other frames the column played (1-based).
+// Nodes below maxDepth plies from the root are counted in their ancestor at that depth.
+static int flame(int argc, char **argv)
+{
+  TraceReader r;
+  if( argc<1 || !r.open(argv[0]) ) return 1;
+  const int maxDepth = argc>1 ? atoi(argv[1]) : 12;
+
+  StackCounts counts;
+  char stack[MAX_PLY * 16] = "";
+  int ends[MAX_PLY + 1]; // end of the stack string at each depth
+  int depth = 0, column = -1;
+  unsigned long long pending = 0;
+
+  while( const TraceEvent *e = r.next() )
+    {
+      pending += e->nodes;
+      if( e->type==TRACE_ENTER || e->type==TRACE_EXIT )
+        {
+          // nodes since the previous change of the stack belong to the current stack
+          if( pending && depth>0 ) counts.add(stack, pending);
+          pending = 0;
+        }
+
+      if( e->type==TRACE_MOVE )
+        column = e->value;
+      else if( e->type==TRACE_ENTER )
+        {
+          if( depth<=maxDepth && depth<MAX_PLY )
+            {
+              int end = depth ? ends[depth - 1] : 0;
+              if( depth==0 )
+                end += sprintf(stack + end, "probe[%i;%i]", e->alpha, e->beta);
+              else
+                end += sprintf(stack + end, ";c%i", column + 1);
+              ends[depth] = end;
+            }
+          depth++;
+        }
+      else if( e->type==TRACE_EXIT && depth>0 )
+        {
+          depth--;
+          int d = depth<=maxDepth ? depth : maxDepth + 1; // deepest frame kept
+          stack[d ? ends[d - 1] : 0] = 0;
+        }
+    }
+
+  for(size_t i = 0; i < counts.size; i++)
+    if( counts.keys[i] ) printf("%s %llu\n", counts.keys[i], counts.counts[i]);
+  return 0;
+}
+
+
+// ------------------------------------------------------------------------------- per-ply summary
+
+
+struct PlyStats {
+  unsigned long long entered, nodes, tableHits, tableMisses, bookHits, cuts, firstMoveCuts, failLows, moves;
+};
+
+static int plies(int argc, char **argv)
+{
+  TraceReader r;
+  if( argc<1 || !r.open(argv[0]) ) return 1;
+
+  static PlyStats stats[MAX_PLY];
+  struct Frame { int ply, alpha, beta, moves; } frames[MAX_PLY];
+  int depth = 0, maxPly = 0;
+  unsigned long long total = 0;
+
+  while( const TraceEvent *e = r.next() )
+    {
+      total += e->nodes;
+      if( depth>0 ) stats[frames[depth - 1].ply].nodes += e->nodes; // nodes of the node itself, or of its endgame search
+      if( e->ply>=MAX_PLY ) continue;
+
+      PlyStats &s = stats[e->ply];
+      switch( e->type )
+        {
+        case TRACE_ENTER:
+          s.entered++;
+          if( e->ply>maxPly ) maxPly = e->ply;
+          if( depth<MAX_PLY ) frames[depth] = { e->ply, e->alpha, e->beta, 0 };
+          depth++;
+          break;
+        case TRACE_MOVE:
+          s.moves++;
+          if( depth>0 ) frames[depth - 1].moves++;
+          break;
+        case TRACE_TABLE_HIT:  s.tableHits++; break;
+        case TRACE_TABLE_MISS: s.tableMisses++; break;
+        case TRACE_BOOK_HIT:   s.bookHits++; break;
+        case TRACE_EXIT:
+          if( depth>0 )
+            {
+              const Frame &f = frames[depth - 1];
+              if( e->value>=f.beta ) { s.cuts++; if( f.moves==1 ) s.firstMoveCuts++; }
+              else if( e->value<=f.alpha ) s.failLows++;
+              depth--;
+            }
+          break;
+        }
+    }
+
+  printf("%ix%i board, %llu nodes\n", r.width, r.height, total);
+  printf("%4s %12s %12s %7s %7s %7s %7s %9s %7s\n",
+         "ply", "entered", "nodes", "table%", "book", "cut%", "first%", "faillow%", "moves");
+  for(int ply = 0; ply <= maxPly; ply++)
+    {
+      const PlyStats &s = stats[ply];
+      if( s.entered==0 ) continue;
+      unsigned long long probes = s.tableHits + s.tableMisses;
+      printf("%4i %12llu %12llu %6.1f%% %7llu %6.1f%% %6.1f%% %8.1f%% %7.2f\n", ply, s.entered, s.nodes,
+             probes ? 100.0 * s.tableHits / probes : 0.0, s.bookHits,
+             100.0 * s.cuts / s.entered, s.cuts ? 100.0 * s.firstMoveCuts / s.cuts : 0.0,
+             100.0 * s.failLows / s.entered, (double) s.moves / s.entered);
+    }
+  return 0;
+}
+
+
+static void usage()
+{
+  printf("usage: connect4-trace <command> [args]\n"
+         "commands:\n"
+         "  flame TRACE [depth]    folded stacks with node counts (input of flamegraph.pl),\n"
+         "                         frames deeper than depth plies are merged (default 12)\n"
+         "  plies TRACE            per-ply summary: nodes, table hits, book hits, cuts,\n"
+         "                         cuts by the first move, fail lows and moves per node\n"
+         "Traces are recorded by solvers built with -DSOLVER_TRACE (see connect4-bench trace).\n");
+}
+
+
+int main(int argc, char **argv)
+{
+  if( argc < 2 ) { usage(); return 1; }
+
+  if( streq(argv[1], "flame") )
+    return flame(argc - 2, argv + 2);
+  else if( streq(argv[1], "plies") )
+    return plies(argc - 2, argv + 2);
+
+  usage();
+  return 1;
+}
@@ -51,6 +51,32 @@ constexpr unsigned int log2(unsigned int n) {
   return n <= 1 ? 0 : log2(n / 2) + 1;
 }
 
+/**
+ * key % divisor computed with modulos of machine words (word_t) only: the most significant
+ * word of the key is reduced first, then the rest digit by digit (Horner scheme), the digits
+ * being small enough for the remainder shifted by one digit to still fit a word.
+ * Modulos of words by a constant are turned into multiplications by the compiler, where a
+ * modulo of a wider key is a library call (__aeabi_uldivmod for 64 bits on 32-bit ARM, that has
+ * no divide instruction at all). The result is the same as key % divisor.
+ * divisor must be less than 2^(8*sizeof(word_t)-1).
+ */
+template<size_t divisor, class word_t = size_t, class key_t>
+inline word_t word_mod(key_t key) {
+  if(sizeof(key_t) <= sizeof(word_t)) return word_t(key) % divisor;
+
+  constexpr int word_bits = 8 * sizeof(word_t);
+  constexpr int key_bits = 8 * sizeof(key_t);
+  constexpr int digit = word_bits - (log2(divisor) + 1); // remainder < 2^(log2(divisor)+1)
+  int shift = key_bits - word_bits;
+  word_t r = word_t(key >> shift) % word_t(divisor); // most significant word first
+  while(shift > 0) {
+    int d = shift < digit ? shift : digit;
+    shift -= d;
+    r = ((r << d) | (word_t(key >> shift) & ((word_t(1) << d) - 1))) % word_t(divisor);
+  }
+  return r;
+}
+
 /**
  * Abstrac interface for the Transposition Table get function
  */
@@ -92,29 +118,93 @@ template<int S> using uint_t =
  * value_size: number of bits of the value
  * log_size:   base 2 log of the size of the Transposition Table.
  *             The table will contain 2^log_size elements
+ * generation_bits: when not 0, the table is made of 2-entry buckets and the top generation_bits
+ *             of each stored partial key hold the generation that wrote the entry (see reset
+ *             and nextGeneration). The partial key then needs one more bit (half as many buckets
+ *             as entries) plus the generation bits. With 0 (the default) the layout is the plain
+ *             array of the opening book files.
+ * value_bits: when not 0, keys and values are packed in a single array of partial_key_t words,
+ *             the value in the low value_bits bits of each entry, so that a probe touches one
+ *             cache line instead of two. The partial key then has value_bits less bits.
+ *             With 0 (the default) keys and values are in two arrays (getKeys and getValues,
+ *             the layout loaded by the opening book).
  */
-template<class partial_key_t, class key_t, class value_t, int log_size>
+template<class partial_key_t, class key_t, class value_t, int log_size, int generation_bits = 0, int value_bits = 0>
 class TranspositionTable : public TableGetter<key_t, value_t> {
  private:
-  static const size_t size = next_prime(1 << log_size); // size of the transition table. Have to be odd to be prime with 2^sizeof(key_t)
-  partial_key_t *K;     // Array to store truncated version of keys;
-  value_t *V;   // Array to store values;
+  static constexpr int ways = generation_bits ? 2 : 1; // entries per bucket
+  static const size_t buckets = next_prime((1 << log_size) / ways); // number of buckets. Have to be odd to be prime with 2^sizeof(key_t)
+  static const size_t size = buckets * ways; // size of the transition table.
+  static constexpr bool packed = value_bits != 0;
+  partial_key_t *K;     // Array to store truncated version of keys (and the values when packed);
+  value_t *V;   // Array to store values, NULL when packed;
+
+  // generations: entries of generation < oldest are empty, entries of generation < current
+  // are kept but replaced first. Generation 0 is an empty slot.
+  static constexpr int key_bits = 8 * sizeof(partial_key_t) - generation_bits - value_bits;
+  static constexpr partial_key_t key_mask = partial_key_t(partial_key_t(~partial_key_t(0)) >> (generation_bits + value_bits));
+  static constexpr partial_key_t value_mask = partial_key_t((partial_key_t(1) << value_bits) - 1);
+  static constexpr unsigned int max_generation = (1u << generation_bits) - 1;
+  unsigned int current, oldest;
 
   void* getKeys()    override {return K;}
   void* getValues()  override {return V;}
   size_t getSize()   override {return size;}
   int getKeySize()   const override {return sizeof(partial_key_t);}
-  int getValueSize() const override {return sizeof(value_t);}
+  int getValueSize() const override {return packed ? 0 : sizeof(value_t);}
 
   size_t index(key_t key) const {
-    return key % size;
+    return word_mod<buckets>(key) * ways;
+  }
+
+  // slots of keys are read and written with one access each, atomic when they are machine words:
+  // with packed entries threads sharing a table never see half written entries (see load_key)
+  static constexpr bool atomic = sizeof(partial_key_t) <= sizeof(size_t);
+  static partial_key_t load_key(const partial_key_t *k, std::true_type) { return __atomic_load_n(k, __ATOMIC_RELAXED); }
+  static partial_key_t load_key(const partial_key_t *k, std::false_type) { return *k; }
+  static void store_key(partial_key_t *k, partial_key_t v, std::true_type) { __atomic_store_n(k, v, __ATOMIC_RELAXED); }
+  static void store_key(partial_key_t *k, partial_key_t v, std::false_type) { *k = v; }
+
+  partial_key_t load(size_t pos) const {
+    return load_key(K + pos, std::integral_constant<bool, atomic>());
+  }
+
+  void store(size_t pos, partial_key_t k) {
+    store_key(K + pos, k, std::integral_constant<bool, atomic>());
+  }
+
+  // generation of an entry (slot content k), 0 if the slot is empty
+  unsigned int generation(partial_key_t k) const {
+    if(!generation_bits) return 1;
+    unsigned int g = (unsigned int)(k >> (generation_bits ? key_bits + value_bits : 0));
+    return g >= oldest ? g : 0;
+  }
+
+  // true if slot content k holds key and was written by a generation that was not reset
+  bool matches(partial_key_t k, key_t key) const {
+    return ((k >> value_bits) & key_mask) == ((partial_key_t)key & key_mask) && generation(k) != 0;
+  }
+
+  // value of slot pos, of content k
+  value_t value(size_t pos, partial_key_t k) const {
+    return packed ? value_t(k & value_mask) : V[pos];
+  }
+
+  void clear() { // fill everything with 0, because 0 value means missing data
+    partial_key_t *k = K, *ke = K + size;
+    while( k<ke ) *k++ = 0;
+    if(!packed) {
+      value_t *v = V, *ve = V + size;
+      while( v<ve ) *v++ = 0;
+    }
+    current = oldest = 1;
   }
 
  public:
   TranspositionTable() {
     K = new partial_key_t[size];
-    V = new value_t[size];
-    reset();
+    V = packed ? NULL : new value_t[size];
+    clear();
   }
 
   ~TranspositionTable() {
@@ -124,12 +214,21 @@ class TranspositionTable : public TableGetter<key_t, value_t> {
 
   /**
    * Empty the Transition Table.
+   * With generations this only starts a new one, all the slots are only cleared
+   * once every 2^generation_bits-1 calls to reset or nextGeneration.
    */
-  void reset() { // fill everything with 0, because 0 value means missing data
-    partial_key_t *k = K, *ke = K + size;
-    while( k<ke ) *k++ = 0;
-    value_t *v, *ve = V + size;
-    while( v<ve ) *v++ = 0;
+  void reset() {
+    if( current==max_generation || !generation_bits ) clear();
+    else oldest = ++current;
+  }
+
+  /**
+   * Start a new generation keeping the current entries (e.g. for a new game):
+   * they can still be found but are replaced before entries of the new generation.
+   */
+  void nextGeneration() {
+    if( current==max_generation || !generation_bits ) clear();
+    else ++current;
   }
 
   /**
@@ -139,8 +238,31 @@ class TranspositionTable : public TableGetter<key_t, value_t> {
    */
   void put(key_t key, value_t value) {
     size_t pos = index(key);
-    K[pos] = key; // key is possibly trucated as key_t is possibly less than key_size bits.
-    V[pos] = value;
+    if(ways == 2) {
+      const partial_key_t first = load(pos);
+      if(!matches(first, key)) {
+        const partial_key_t second = load(pos + 1);
+        if(matches(second, key) || generation(second) < generation(first)) pos++; // replace the older entry
+        else if(generation(first) == current) { // both entries are recent: move the first one to the second slot
+          store(pos + 1, first);
+          if(!packed) V[pos + 1] = V[pos];
+        }
+      }
+    }
+    partial_key_t k = ((partial_key_t)key & key_mask) << value_bits; // key is possibly trucated as key_t is possibly less than key_size bits.
+    if(generation_bits) k |= (partial_key_t)current << (generation_bits ? key_bits + value_bits : 0);
+    if(packed) k |= (partial_key_t)value & value_mask;
+    else V[pos] = value;
+    store(pos, k);
+  }
+
+  /**
+   * Start loading the slots of a key into the cache, ahead of a get or put.
+   */
+  void prefetch(key_t key) const {
+    size_t pos = index(key);
+    __builtin_prefetch(K + pos);
+    if(!packed) __builtin_prefetch(V + pos);
   }
 
   /**
@@ -150,13 +272,16 @@ class TranspositionTable : public TableGetter<key_t, value_t> {
    */
   value_t get(key_t key) const override {
     size_t pos = index(key);
-    if(K[pos] == (partial_key_t)key) return V[pos]; // need to cast to key_t because key may be truncated due to size of key_t
+    partial_key_t k = load(pos);
+    if(matches(k, key)) return value(pos, k); // need to cast to key_t because key may be truncated due to size of key_t
+    else if(ways == 2 && matches(k = load(pos + 1), key)) return value(pos + 1, k);
     else return 0;
   }
 
   bool isCollision(key_t key) const override {
     size_t pos = index(key);
-    return (K[pos] !=0 && K[pos] != (partial_key_t)key); 
+    partial_key_t k = load(pos);
+    return (k !=0 && !matches(k, key));
   }
   
 };
@@ -66,9 +66,32 @@ int main(int argc, char **argv)
       exit(0);
     }
 
+  // usage: connect4.exe [-w|-r|-p] [-e] [WxH] moves
+  //   -w: win/draw/loss answer only, -r: win/draw/loss answer followed by exact answer
+  //   -p: win/draw/loss answer by the proof-number search raced with negamax
+  //   -e: effort estimate in the acknowledgement ("!eNN")
+  //   WxH: board size, e.g. "6x5 3344"
+  int width = 7, height = 6, w, h, flags = 0;
+  const char *moves = "";
+  for(int i=1; i<argc; i++)
+    {
+      if( argv[i][0]=='-' && argv[i][1]=='w' )
+        flags |= SOLVER_WDL;
+      else if( argv[i][0]=='-' && argv[i][1]=='r' )
+        flags |= SOLVER_REFINE;
+      else if( argv[i][0]=='-' && argv[i][1]=='p' )
+        flags |= SOLVER_PROOF;
+      else if( argv[i][0]=='-' && argv[i][1]=='e' )
+        flags |= SOLVER_ESTIMATE;
+      else if( i<argc-1 && sscanf(argv[i], "%ix%i", &w, &h)==2 ) 
+        { width = w; height = h; }
+      else
+        moves = argv[i];
+    }
+
   srand(time(NULL));
   long long t1 = timeInMilliseconds();
-  const char *s = solver_solve(argc>1 ? argv[1] : "", &n);
+  const char *s = solver_solve_board(width, height, moves, flags, &n);
   long long t2 = timeInMilliseconds();
   uart_write_str(s==NULL ? "?" : s);
   printf("\nnodes: %I64u, time: %I64i milliseconds\n", n, t2-t1);
@@ -287,7 +310,7 @@ void entry_point()
 
   while(1)
     {
-      int n;
+      int n, flags;
       char c, pos[50], ok = 0;
       const char *result;
 
@@ -298,10 +321,19 @@ void entry_point()
 
       n = 0;
       ok = 1;
+      flags = 0;
       while( ok && (c=uart_read_byte()) != '?' ) 
         { 
           if( c>='1' && c<='7' && n<42 )
             pos[n++] = c; 
+          else if( c=='w' )
+            flags |= SOLVER_WDL;    // win/draw/loss answer only
+          else if( c=='r' )
+            flags |= SOLVER_REFINE; // win/draw/loss answer, then exact answer
+          else if( c=='p' )
+            flags |= SOLVER_PROOF;  // win/draw/loss answer, proof-number search raced with negamax
+          else if( c=='e' )
+            flags |= SOLVER_ESTIMATE; // effort estimate in the acknowledgement
           else if( !isspace(c) )
             ok = 0;
         }
@@ -314,7 +346,7 @@ void entry_point()
           if( first ) srand(time_microsec());
           //t1 = time_microsec() / 1000;
           //t = get_temp(); uart_write_str(" "); uart_write_str(u2s(t)); 
-          result = solver_solve(pos, NULL);
+          result = solver_solve_ex(pos, flags, NULL);
           //t = get_temp(); uart_write_str(" "); uart_write_str(u2s(t)); uart_write_str(" "); 
           //t2 = time_microsec() / 1000;
           if( result )
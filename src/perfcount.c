@@ -0,0 +1,41 @@
+#include "perfcount.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+int perfcount_open( PERFCOUNT_EVENT event )
+{
+#ifdef __linux__
+    static const unsigned long long configs[] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES
+    };
+
+    struct perf_event_attr attr = {0};
+    attr.size           = sizeof(attr);
+    attr.type           = PERF_TYPE_HARDWARE;
+    attr.config         = configs[event];
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+
+    return (int) syscall( __NR_perf_event_open, &attr, 0, -1, -1, 0 );
+#else
+    return -1;
+#endif
+}
+
+
+unsigned long long perfcount_read( int handle )
+{
+    unsigned long long value = 0;
+#ifdef __linux__
+    if( handle < 0 || read( handle, &value, sizeof(value) ) != sizeof(value) )
+        value = 0;
+#endif
+    return value;
+}
@@ -0,0 +1,27 @@
+#ifndef _PERFCOUNT_H_
+#define _PERFCOUNT_H_
+
+// hardware event counters of the calling process, for the x86 benchmarks (Linux perf events)
+
+typedef enum {
+PERFCOUNT_CYCLES       =0,
+PERFCOUNT_INSTRUCTIONS =1,
+PERFCOUNT_CACHE_MISSES =2
+} PERFCOUNT_EVENT;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// returns a counter handle, -1 if the event can not be counted here
+extern int perfcount_open( PERFCOUNT_EVENT event );
+
+// returns the current count of the counter, 0 for an invalid handle
+extern unsigned long long perfcount_read( int handle );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,478 @@
+// -----------------------------------------------------------------------------
+// Connect 4 solver on bare metal Raspberry Pi Zero
+// Copyright (C) 2019 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+// Long-running x86 solver server speaking the serial protocol of the Raspberry Pi
+// ("!moves?", see README.md) on a Unix socket, a TCP port on the loopback interface
+// or a pseudo-terminal (a local stand-in for the UART).
+//
+// usage: connect4-server [-j workers] [-t threads] [-q queue] [-v] unix:PATH | tcp:PORT | pty
+//
+// Each client connection has a reader thread parsing its queries. Queries are queued
+// and solved by a pool of workers, each with its own solver instance (transposition
+// table and answer cache) kept between queries, the opening books being loaded once
+// and shared. A client has at most one query in progress, like a robot on a serial line.
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <termios.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "Solver.hpp"
+
+
+// the solver expects these from the board support code (see main.c)
+void act_led(int on) {}
+void uart_write(const char *s, unsigned int n) {}
+
+
+struct worker;
+
+struct client
+{
+  int fd;
+  int id;
+  int pty;                    // fd is the master side of a pseudo-terminal
+  pthread_mutex_t writeLock;  // answers are written by the workers
+  pthread_cond_t  done;       // signaled when the query of the client is answered
+  int busy;                   // a query of the client is queued or being solved
+  struct worker *lastWorker;  // worker whose tables hold the game of the client
+  char buffer[256];
+  int bufferStart, bufferEnd;
+};
+
+struct request
+{
+  struct client *client;
+  char moves[50];
+  int flags;
+  long long queued;           // time in microseconds
+  struct request *next;
+};
+
+struct worker
+{
+  int id;
+  solver_t *solver;
+  struct client *client;      // client of the query being solved
+  pthread_t thread;
+};
+
+
+static pthread_mutex_t queueLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  queueNotEmpty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  queueNotFull = PTHREAD_COND_INITIALIZER;
+static struct request *queueHead = NULL, *queueTail = NULL;
+static int queueLength = 0, maxQueueLength = 64;
+static int verbose = 0;
+
+
+static long long timeInMicroseconds(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return ((long long)tv.tv_sec)*1000000 + tv.tv_usec;
+}
+
+
+static void clientWrite(struct client *c, const char *s, unsigned int n)
+{
+  pthread_mutex_lock(&c->writeLock);
+  while( n>0 )
+    {
+      ssize_t k = write(c->fd, s, n);
+      if( k<0 && errno==EINTR ) continue;
+      if( k<=0 ) break; // client gone, its reader thread will notice
+      s += k;
+      n -= k;
+    }
+  pthread_mutex_unlock(&c->writeLock);
+}
+
+
+// transport of the solver instances: "!" and early answers go to the client being served
+static void workerTransport(void *context, const char *s, unsigned int n)
+{
+  struct worker *w = (struct worker *) context;
+  clientWrite(w->client, s, n);
+}
+
+
+// -------------------------------------------------------------------- request queue
+
+
+static void enqueue(struct request *r)
+{
+  pthread_mutex_lock(&queueLock);
+  while( queueLength>=maxQueueLength )
+    pthread_cond_wait(&queueNotFull, &queueLock);
+
+  r->next = NULL;
+  if( queueTail ) queueTail->next = r; else queueHead = r;
+  queueTail = r;
+  queueLength++;
+  pthread_cond_broadcast(&queueNotEmpty);
+  pthread_mutex_unlock(&queueLock);
+}
+
+
+// oldest request of a client last served by worker w (its game is still in the tables
+// of that worker), else the oldest request
+static struct request *dequeue(struct worker *w)
+{
+  struct request *r, *prev = NULL;
+
+  pthread_mutex_lock(&queueLock);
+  while( queueHead==NULL )
+    pthread_cond_wait(&queueNotEmpty, &queueLock);
+
+  for(r=queueHead; r; prev=r, r=r->next)
+    if( r->client->lastWorker==w ) break;
+
+  if( r==NULL ) { r = queueHead; prev = NULL; }
+
+  if( prev ) prev->next = r->next; else queueHead = r->next;
+  if( queueTail==r ) queueTail = prev;
+  queueLength--;
+  pthread_cond_signal(&queueNotFull);
+  pthread_mutex_unlock(&queueLock);
+  return r;
+}
+
+
+// -------------------------------------------------------------------- workers
+
+
+static void *workerThread(void *arg)
+{
+  struct worker *w = (struct worker *) arg;
+  char result[5];
+
+  while( 1 )
+    {
+      struct request *r = dequeue(w);
+      struct client *c = r->client;
+      unsigned long long nodes = 0;
+      long long t = timeInMicroseconds();
+      const char *s;
+
+      w->client = c;
+      s = solver_solve_r(w->solver, r->moves, r->flags, result, &nodes);
+      clientWrite(c, s ? s : "?", s ? 4 : 1);
+
+      if( verbose )
+        fprintf(stderr, "client %i, worker %i: %s%s%s%s%s -> %s, %llu nodes, queued %lli us, solved %lli us\n",
+                c->id, w->id, r->moves, (r->flags & SOLVER_WDL) ? " w" : "", (r->flags & SOLVER_REFINE) ? " r" : "",
+                (r->flags & SOLVER_PROOF) ? " p" : "", (r->flags & SOLVER_ESTIMATE) ? " e" : "",
+                s ? s : "?", nodes, t - r->queued, timeInMicroseconds() - t);
+
+      free(r);
+      pthread_mutex_lock(&c->writeLock);
+      c->lastWorker = w;
+      c->busy = 0;
+      pthread_cond_signal(&c->done);
+      pthread_mutex_unlock(&c->writeLock);
+    }
+
+  return NULL;
+}
+
+
+// -------------------------------------------------------------------- clients
+
+
+// next byte sent by the client, -1 when the client is gone
+static int clientRead(struct client *c)
+{
+  while( c->bufferStart==c->bufferEnd )
+    {
+      ssize_t n = read(c->fd, c->buffer, sizeof(c->buffer));
+      if( n<0 && errno==EINTR ) continue;
+      if( n<=0 )
+        {
+          // the master side of a pseudo-terminal reports EIO while no program has the
+          // slave side open, wait for the next one
+          if( c->pty ) { usleep(100000); continue; }
+          return -1;
+        }
+      c->bufferStart = 0;
+      c->bufferEnd = n;
+    }
+
+  return (unsigned char) c->buffer[c->bufferStart++];
+}
+
+
+static void *clientThread(void *arg)
+{
+  struct client *c = (struct client *) arg;
+  int ch;
+
+  if( verbose ) fprintf(stderr, "client %i connected\n", c->id);
+
+  while( 1 )
+    {
+      struct request *r;
+      int n = 0, ok = 1, flags = 0;
+      char pos[50];
+
+      // same framing as entry_point() in main.c
+      while( (ch = clientRead(c))>=0 && ch!='!' );
+      if( ch<0 ) break;
+
+      while( ok && (ch = clientRead(c))>=0 && ch!='?' )
+        {
+          if( ch>='1' && ch<='7' && n<42 )
+            pos[n++] = ch;
+          else if( ch=='w' )
+            flags |= SOLVER_WDL;    // win/draw/loss answer only
+          else if( ch=='r' )
+            flags |= SOLVER_REFINE; // win/draw/loss answer, then exact answer
+          else if( ch=='p' )
+            flags |= SOLVER_PROOF;  // win/draw/loss answer, proof-number search raced with negamax
+          else if( ch=='e' )
+            flags |= SOLVER_ESTIMATE; // effort estimate in the acknowledgement
+          else if( ch!=' ' && ch!='\t' && ch!='\r' && ch!='\n' )
+            ok = 0;
+        }
+      if( ch<0 ) break;
+
+      if( !ok )
+        {
+          clientWrite(c, "?", 1);
+          continue;
+        }
+
+      r = (struct request *) malloc(sizeof(struct request));
+      memcpy(r->moves, pos, n);
+      r->moves[n] = 0;
+      r->flags = flags;
+      r->client = c;
+      r->queued = timeInMicroseconds();
+
+      // one query at a time per client: wait for the answer before reading the next one
+      c->busy = 1;
+      enqueue(r);
+      pthread_mutex_lock(&c->writeLock);
+      while( c->busy ) pthread_cond_wait(&c->done, &c->writeLock);
+      pthread_mutex_unlock(&c->writeLock);
+    }
+
+  if( verbose ) fprintf(stderr, "client %i disconnected\n", c->id);
+  close(c->fd);
+  pthread_mutex_destroy(&c->writeLock);
+  pthread_cond_destroy(&c->done);
+  free(c);
+  return NULL;
+}
+
+
+static void startClient(int fd, int pty)
+{
+  static int nextId = 1;
+  pthread_t thread;
+  struct client *c = (struct client *) calloc(1, sizeof(struct client));
+
+  c->fd = fd;
+  c->id = nextId++;
+  c->pty = pty;
+  pthread_mutex_init(&c->writeLock, NULL);
+  pthread_cond_init(&c->done, NULL);
+
+  if( pthread_create(&thread, NULL, clientThread, c)!=0 )
+    {
+      close(fd);
+      free(c);
+      return;
+    }
+  pthread_detach(thread);
+}
+
+
+// -------------------------------------------------------------------- listeners
+
+
+static int listenUnix(const char *path)
+{
+  struct sockaddr_un addr;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if( fd<0 ) return -1;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path)-1);
+  unlink(path);
+  if( bind(fd, (struct sockaddr *) &addr, sizeof(addr))<0 || listen(fd, 16)<0 )
+    {
+      close(fd);
+      return -1;
+    }
+  return fd;
+}
+
+
+static int listenTcp(int port)
+{
+  struct sockaddr_in addr;
+  int one = 1, fd = socket(AF_INET, SOCK_STREAM, 0);
+  if( fd<0 ) return -1;
+
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if( bind(fd, (struct sockaddr *) &addr, sizeof(addr))<0 || listen(fd, 16)<0 )
+    {
+      close(fd);
+      return -1;
+    }
+  return fd;
+}
+
+
+// master side of a new pseudo-terminal whose slave side is set to raw mode (no echo,
+// no line buffering) as a serial line. The slave side is kept open so that the master
+// does not report EIO between two programs using it.
+static int openPty(void)
+{
+  struct termios tio;
+  const char *name;
+  int slave, fd = posix_openpt(O_RDWR | O_NOCTTY);
+  if( fd<0 || grantpt(fd)<0 || unlockpt(fd)<0 || (name = ptsname(fd))==NULL ) return -1;
+
+  slave = open(name, O_RDWR | O_NOCTTY);
+  if( slave<0 ) return -1;
+  tcgetattr(slave, &tio);
+  cfmakeraw(&tio);
+  tcsetattr(slave, TCSANOW, &tio);
+
+  printf("serial line: %s\n", name);
+  fflush(stdout);
+  return fd;
+}
+
+
+static void usage(void)
+{
+  printf("usage: connect4-server [-j workers] [-t threads] [-q queue] [-v] unix:PATH | tcp:PORT | pty\n"
+         "  -j workers  number of solver instances solving queries in parallel\n"
+         "              (default: number of processors)\n"
+         "  -t threads  threads of each worker running the probes of a search in parallel\n"
+         "              (default 1, needs a build with -DTABLE_SHARED)\n"
+         "  -q queue    maximum number of queued queries (default 64)\n"
+         "  -v          log connections and queries to stderr\n"
+         "  unix:PATH   listen on a Unix socket\n"
+         "  tcp:PORT    listen on a TCP port of the loopback interface\n"
+         "  pty         serve a pseudo-terminal, its name is printed at startup\n");
+}
+
+
+int main(int argc, char **argv)
+{
+  int i, fd = -1, workers = sysconf(_SC_NPROCESSORS_ONLN), threads = 1;
+  const char *address = NULL;
+  struct worker *pool;
+
+  for(i=1; i<argc; i++)
+    {
+      if( strcmp(argv[i], "-j")==0 && i+1<argc )
+        workers = atoi(argv[++i]);
+      else if( strcmp(argv[i], "-t")==0 && i+1<argc )
+        threads = atoi(argv[++i]);
+      else if( strcmp(argv[i], "-q")==0 && i+1<argc )
+        maxQueueLength = atoi(argv[++i]);
+      else if( strcmp(argv[i], "-v")==0 )
+        verbose = 1;
+      else if( address==NULL )
+        address = argv[i];
+      else
+        { usage(); return 1; }
+    }
+
+  if( address==NULL || workers<1 || threads<1 || maxQueueLength<1 ) { usage(); return 1; }
+
+  signal(SIGPIPE, SIG_IGN); // writes to closed connections fail instead
+  srand(time(NULL));
+
+  if( strncmp(address, "unix:", 5)==0 )
+    fd = listenUnix(address+5);
+  else if( strncmp(address, "tcp:", 4)==0 )
+    fd = listenTcp(atoi(address+4));
+  else if( strcmp(address, "pty")==0 )
+    fd = openPty();
+  else
+    { usage(); return 1; }
+
+  if( fd<0 )
+    {
+      fprintf(stderr, "can't open %s: %s\n", address, strerror(errno));
+      return 1;
+    }
+
+  // the solver instances are created up front: books are loaded and tables allocated
+  // before the first query
+  pool = (struct worker *) calloc(workers, sizeof(struct worker));
+  for(i=0; i<workers; i++)
+    {
+      solver_config config = { 7, 6, 0, workerTransport, &pool[i], threads };
+      config.seed = rand() | 1;
+      pool[i].id = i;
+      pool[i].solver = solver_create(&config);
+      if( pool[i].solver==NULL || pthread_create(&pool[i].thread, NULL, workerThread, &pool[i])!=0 )
+        {
+          fprintf(stderr, "can't start worker %i\n", i);
+          return 1;
+        }
+    }
+
+  if( verbose ) fprintf(stderr, "%i workers serving %s\n", workers, address);
+
+  if( strcmp(address, "pty")==0 )
+    {
+      startClient(fd, 1);
+      pthread_exit(NULL); // the client thread serves the pseudo-terminal forever
+    }
+
+  while( 1 )
+    {
+      int c = accept(fd, NULL, NULL);
+      if( c<0 )
+        {
+          if( errno==EINTR || errno==ECONNABORTED ) continue;
+          fprintf(stderr, "accept: %s\n", strerror(errno));
+          return 1;
+        }
+      startClient(c, 0);
+    }
+
+  return 0;
+}
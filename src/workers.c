@@ -0,0 +1,95 @@
+#include "workers.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#define MAX_POLL 64
+
+
+int workers_processors( void )
+{
+    return (int) sysconf( _SC_NPROCESSORS_ONLN );
+}
+
+
+int workers_start( int (*run)( int fd ), int *pid )
+{
+    int fds[2];
+    if( socketpair( AF_UNIX, SOCK_STREAM, 0, fds )!=0 ) return -1;
+
+    *pid = fork();
+    if( *pid<0 )
+    {
+        close( fds[0] );
+        close( fds[1] );
+        return -1;
+    }
+    if( *pid==0 )
+    {
+        close( fds[0] );
+        exit( run( fds[1] ) );
+    }
+    close( fds[1] );
+    return fds[0];
+}
+
+
+int workers_read( int fd, char *buf, int size, int wait )
+{
+    for(;;)
+    {
+        if( !wait )
+        {
+            struct pollfd p = { fd, POLLIN, 0 };
+            if( poll( &p, 1, 0 )==0 ) return 0;
+        }
+        ssize_t n = read( fd, buf, size );
+        if( n<0 && errno==EINTR ) continue;
+        return n>0 ? (int) n : -1;
+    }
+}
+
+
+int workers_write( int fd, const char *buf, int n )
+{
+    while( n>0 )
+    {
+        ssize_t k = write( fd, buf, n );
+        if( k<0 && errno==EINTR ) continue;
+        if( k<=0 ) return -1;
+        buf += k;
+        n -= k;
+    }
+    return 0;
+}
+
+
+int workers_poll( const int *fds, int n, int *ready )
+{
+    struct pollfd p[MAX_POLL];
+    int i;
+    if( n>MAX_POLL ) return -1;
+
+    for(i=0; i<n; i++)
+    {
+        p[i].fd = fds[i];
+        p[i].events = POLLIN;
+        p[i].revents = 0;
+    }
+    while( poll( p, n, -1 )<0 )
+        if( errno!=EINTR ) return -1;
+    for(i=0; i<n; i++) ready[i] = p[i].revents!=0;
+    return 0;
+}
+
+
+void workers_stop( int fd, int pid )
+{
+    shutdown( fd, SHUT_RDWR ); // later workers hold copies of the socket, closing it is not enough
+    close( fd );
+    waitpid( pid, NULL, 0 );
+}
@@ -0,0 +1,35 @@
+#ifndef _WORKERS_H_
+#define _WORKERS_H_
+
+// local worker processes talking to their parent over Unix socket pairs (x86 only)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// returns the number of processors online
+extern int workers_processors( void );
+
+// forks a worker process running run() on its end of a new socket pair, then exiting
+// with the result of run(). returns the other end of the socket pair, -1 on error
+extern int workers_start( int (*run)( int fd ), int *pid );
+
+// reads up to size bytes, waiting for them if wait is set. returns the number of bytes
+// read (0 if none is available without waiting), -1 at the end of the stream or on error
+extern int workers_read( int fd, char *buf, int size, int wait );
+
+// writes n bytes, returns -1 if the other side is gone
+extern int workers_write( int fd, const char *buf, int n );
+
+// waits until one of the n sockets can be read, ready[i] is then set for each of them.
+// returns -1 on error
+extern int workers_poll( const int *fds, int n, int *ready );
+
+// ends the stream of a worker (even if other processes share its socket) and waits for it to exit
+extern void workers_stop( int fd, int pid );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif